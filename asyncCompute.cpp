@@ -0,0 +1,262 @@
+#include "asyncCompute.h"
+
+#include "computeHelpers.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <latch>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+
+namespace
+{
+using bufferData_t = int32_t;
+
+// How long the poller blocks on the in-flight fences before it picks up newly submitted jobs.
+// Vulkan 1.1 cannot signal a fence from the host, so the poller cannot be woken when a job is
+// submitted; the new fence joins the wait when one of the fences it already waits on signals, or
+// when this expires. Jobs on one queue start in submission order, so the first usually comes
+// first, and this bounds the added latency otherwise at the cost of a wakeup per timeout while
+// jobs are in flight.
+constexpr uint64_t pollTimeoutNs = 100'000;
+
+struct LoadTestJob
+{
+    std::vector<bufferData_t> input;
+    std::vector<bufferData_t> output;
+    double latencyMs = 0.0;
+};
+
+DetachedTask runLoadTestJob(ComputeContext& context, LoadTestJob& job, std::latch& done)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    co_await context.copy(job.input, job.output);
+    job.latencyMs = elapsedSince(start);
+    done.count_down();
+}
+} // namespace
+
+ComputeContext::ComputeContext(const vk::raii::PhysicalDevice& physDev,
+                               const uint32_t maxJobLength, const uint32_t slotCount,
+                               Resumer completionResumer)
+    : maxJobLength(maxJobLength),
+      queueFamilyIndex(requireComputeQueue(physDev)),
+      localGroupSize(getLocalGroupSize(physDev, maxJobLength)),
+      slotLength(copySlotLength(maxJobLength, localGroupSize)),
+      device(getDevice(physDev, queueFamilyIndex)),
+      queue(device, queueFamilyIndex, 0),
+      descriptorSetLayout(makeDescriptorSetLayout(device)),
+      pipelineLayout(makePipelineLayout(device, descriptorSetLayout)),
+      pipeline(makePipeline(device, pipelineLayout, getSpirvFromFile("copy.comp.spv"),
+                            std::array{localGroupSize})),
+      descriptorPool(makeDescriptorPool(device, slotCount)),
+      commandPool(device,
+                  vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                            queueFamilyIndex)),
+      commandBuffers(device, vk::CommandBufferAllocateInfo(
+                                 *commandPool, vk::CommandBufferLevel::ePrimary, slotCount)),
+      copySlots(makeCopySlots(device, physDev, queueFamilyIndex, slotLength, slotCount)),
+      resumer(completionResumer ? std::move(completionResumer)
+                                : [](std::coroutine_handle<> handle) { handle.resume(); })
+{
+    for (const auto& buffers : copySlots.slots)
+    {
+        auto descriptorSet = allocateDescriptorSet(device, descriptorPool, descriptorSetLayout);
+        updateDescriptorSetsWithBufferInfo(
+            device, std::array{*buffers.in_buffer, *buffers.out_buffer}, descriptorSet);
+        slots.push_back({std::move(descriptorSet), vk::raii::Fence(device, vk::FenceCreateInfo()),
+                         std::nullopt});
+    }
+
+    std::ranges::copy(std::views::iota(0u, slotCount), std::back_inserter(freeSlots));
+    poller = std::jthread([this](std::stop_token stop) { pollCompletions(stop); });
+}
+
+ComputeContext::~ComputeContext()
+{
+    poller.request_stop();
+    poller.join();
+    queue.waitIdle();
+}
+
+ComputeContext::CopyAwaiter ComputeContext::copy(const std::span<const int32_t> input,
+                                                 const std::span<int32_t> output)
+{
+    // checked in release builds too: a longer job would be written past its slot into the mapped
+    // buffers of other in-flight jobs
+    if (input.size() != output.size())
+    {
+        throw std::invalid_argument("copy input and output lengths differ");
+    }
+    if (input.size() > maxJobLength)
+    {
+        throw std::length_error("copy job longer than the context's maxJobLength");
+    }
+    return CopyAwaiter(*this, input, output);
+}
+
+void ComputeContext::CopyAwaiter::await_suspend(const std::coroutine_handle<> handle)
+{
+    // the job may complete and resume the coroutine (destroying this awaiter) before enqueue
+    // returns, so nothing may touch the awaiter afterwards
+    context.enqueue({input, output, handle});
+}
+
+void ComputeContext::enqueue(Job job)
+{
+    const std::lock_guard lock(mutex);
+    if (freeSlots.empty())
+    {
+        pendingJobs.push_back(job);
+        return;
+    }
+
+    const auto slotIndex = freeSlots.back();
+    freeSlots.pop_back();
+    startJob(slotIndex, job);
+    inFlightChanged.notify_one();
+}
+
+void ComputeContext::startJob(const uint32_t slotIndex, Job job)
+{
+    auto& slot = slots[slotIndex];
+    std::ranges::copy(job.input, copySlots.input(slotIndex));
+
+    const auto& commandBuffer = commandBuffers[slotIndex];
+    commandBuffer.reset();
+    commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0,
+                                     *slot.descriptorSet, nullptr);
+    commandBuffer.dispatch(div_up(job.input.size(), localGroupSize), 1, 1);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {},
+        vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead),
+        nullptr, nullptr);
+    commandBuffer.end();
+
+    queue.submit(vk::SubmitInfo(nullptr, nullptr, *commandBuffer), *slot.fence);
+    slot.job = job;
+    inFlightSlots.push_back(slotIndex);
+}
+
+void ComputeContext::pollCompletions(const std::stop_token stop)
+{
+    std::vector<vk::Fence> fences;
+    std::vector<std::coroutine_handle<>> finished;
+    while (!stop.stop_requested())
+    {
+        fences.clear();
+        {
+            std::unique_lock lock(mutex);
+            if (!inFlightChanged.wait(lock, stop, [this] { return !inFlightSlots.empty(); }))
+            {
+                return;
+            }
+            for (const auto slotIndex : inFlightSlots)
+            {
+                fences.push_back(*slots[slotIndex].fence);
+            }
+        }
+
+        const auto waitResult = device.waitForFences(fences, VK_FALSE, pollTimeoutNs);
+        if (waitResult == vk::Result::eTimeout)
+        {
+            continue;
+        }
+
+        finished.clear();
+        {
+            const std::lock_guard lock(mutex);
+            std::erase_if(inFlightSlots, [&](const uint32_t slotIndex) {
+                auto& slot = slots[slotIndex];
+                if (slot.fence.getStatus() != vk::Result::eSuccess)
+                {
+                    return false;
+                }
+
+                const auto& job = *slot.job;
+                const auto* result = copySlots.output(slotIndex);
+                std::copy(result, result + job.output.size(), job.output.begin());
+                finished.push_back(job.handle);
+                slot.job.reset();
+                device.resetFences(*slot.fence);
+                freeSlots.push_back(slotIndex);
+                return true;
+            });
+
+            // hand the freed slots straight to waiting jobs
+            while (!freeSlots.empty() && !pendingJobs.empty())
+            {
+                const auto slotIndex = freeSlots.back();
+                freeSlots.pop_back();
+                startJob(slotIndex, pendingJobs.front());
+                pendingJobs.pop_front();
+            }
+        }
+
+        for (const auto handle : finished)
+        {
+            resumer(handle);
+        }
+    }
+}
+
+int asyncCopyLoadTest(const vk::raii::PhysicalDevice& physDev, const uint32_t jobCount,
+                      const uint32_t jobLength, const unsigned threadCount)
+{
+    ComputeContext context(physDev, jobLength);
+
+    std::vector<LoadTestJob> jobs(jobCount);
+    {
+        auto rng = std::mt19937(std::chrono::steady_clock::now().time_since_epoch().count());
+        for (auto& job : jobs)
+        {
+            job.input.resize(jobLength);
+            job.output.resize(jobLength);
+            std::ranges::generate(job.input, rng);
+        }
+    }
+
+    std::latch done(jobCount);
+    const auto start = std::chrono::high_resolution_clock::now();
+    {
+        std::vector<std::jthread> launchers;
+        for (const auto thread : std::views::iota(0u, threadCount))
+        {
+            launchers.emplace_back([&, thread] {
+                for (auto index = thread; index < jobCount; index += threadCount)
+                {
+                    runLoadTestJob(context, jobs[index], done);
+                }
+            });
+        }
+    }
+    done.wait();
+    const auto elapsed = elapsedSince(start);
+
+    const auto badJobs = std::ranges::count_if(
+        jobs, [](const auto& job) { return !std::ranges::equal(job.input, job.output); });
+    if (badJobs != 0)
+    {
+        std::cout << badJobs << " async copies did not match\n";
+    }
+
+    std::vector<double> latencies;
+    std::ranges::transform(jobs, std::back_inserter(latencies),
+                           [](const auto& job) { return job.latencyMs; });
+    std::ranges::sort(latencies);
+    std::cout << "Async copy load test: " << jobCount << " jobs of " << jobLength
+              << " elements from " << threadCount << " threads\n"
+              << "  throughput: " << jobCount / (elapsed / 1000.0) << " jobs/s over " << elapsed
+              << " ms\n"
+              << "  latency ms: p50 " << percentile(latencies, 0.5) << ", p90 "
+              << percentile(latencies, 0.9) << ", p99 " << percentile(latencies, 0.99)
+              << ", p99.9 " << percentile(latencies, 0.999) << ", max " << latencies.back()
+              << "\n";
+    return 0;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "computeHelpers.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Fire-and-forget coroutine type for code that only needs to co_await the context.
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() noexcept
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void() noexcept
+        {
+        }
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// Keeps one device and copy pipeline warm and runs copies asynchronously:
+//
+//     co_await context.copy(input, output);
+//
+// Each in-flight job owns one of a fixed number of slots (buffers, descriptor set, command buffer
+// and fence); jobs beyond that wait in a queue for a slot to free up. A poller thread waits on the
+// fences of in-flight jobs and hands each finished coroutine to the resumer, which by default
+// resumes it on the poller thread. An event loop can pass a resumer that posts the handle to its
+// own queue (e.g. behind an eventfd) instead. A job submitted while the poller is blocked is only
+// waited on once an earlier job finishes, or after at most 0.1 ms, which bounds how much later
+// than its fence the coroutine can resume.
+//
+// All jobs must have completed before the context is destroyed.
+class ComputeContext
+{
+  public:
+    using Resumer = std::function<void(std::coroutine_handle<>)>;
+
+    ComputeContext(const vk::raii::PhysicalDevice& physDev, uint32_t maxJobLength,
+                   uint32_t slotCount = 64, Resumer completionResumer = {});
+    ~ComputeContext();
+
+    ComputeContext(const ComputeContext&) = delete;
+    ComputeContext& operator=(const ComputeContext&) = delete;
+
+    class CopyAwaiter
+    {
+      public:
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept
+        {
+        }
+
+      private:
+        friend class ComputeContext;
+        CopyAwaiter(ComputeContext& context, std::span<const int32_t> input,
+                    std::span<int32_t> output)
+            : context(context), input(input), output(output)
+        {
+        }
+
+        ComputeContext& context;
+        std::span<const int32_t> input;
+        std::span<int32_t> output;
+    };
+
+    // input and output must be the same length, at most maxJobLength, and stay alive until the
+    // awaiting coroutine resumes. Throws std::invalid_argument or std::length_error otherwise.
+    CopyAwaiter copy(std::span<const int32_t> input, std::span<int32_t> output);
+
+  private:
+    struct Job
+    {
+        std::span<const int32_t> input;
+        std::span<int32_t> output;
+        std::coroutine_handle<> handle;
+    };
+
+    // slots[i] works on the buffers of copySlots.slots[i]
+    struct Slot
+    {
+        vk::raii::DescriptorSet descriptorSet;
+        vk::raii::Fence fence;
+        std::optional<Job> job;
+    };
+
+    void enqueue(Job job);
+    // must be called with mutex held
+    void startJob(uint32_t slotIndex, Job job);
+    void pollCompletions(std::stop_token stop);
+
+    uint32_t maxJobLength;
+    uint32_t queueFamilyIndex;
+    uint32_t localGroupSize;
+    uint32_t slotLength; // maxJobLength rounded up to whole workgroups
+    vk::raii::Device device;
+    vk::raii::Queue queue;
+    vk::raii::DescriptorSetLayout descriptorSetLayout;
+    vk::raii::PipelineLayout pipelineLayout;
+    vk::raii::Pipeline pipeline;
+    vk::raii::DescriptorPool descriptorPool;
+    vk::raii::CommandPool commandPool;
+    vk::raii::CommandBuffers commandBuffers;
+    CopySlots copySlots;
+    std::vector<Slot> slots;
+    Resumer resumer;
+
+    std::mutex mutex;
+    std::condition_variable_any inFlightChanged;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> inFlightSlots;
+    std::deque<Job> pendingJobs;
+    // declared last so it is stopped before anything it uses is destroyed
+    std::jthread poller;
+};
+
+// Launches jobCount copies of jobLength elements from threadCount threads, all in flight at once,
+// then checks them and reports throughput and latency percentiles.
+int asyncCopyLoadTest(const vk::raii::PhysicalDevice& physDev, uint32_t jobCount,
+                      uint32_t jobLength, unsigned threadCount);
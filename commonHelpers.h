@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+
+// Helpers that do not need Vulkan, so the host paths can share them with the device ones.
+
+constexpr auto div_up(const std::unsigned_integral auto x, const std::unsigned_integral auto y)
+{
+    return (x + y - 1u) / y;
+}
+
+inline auto elapsedSince(const auto start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                     start)
+        .count();
+}
@@ -0,0 +1,220 @@
+#include "computeCache.h"
+
+#include "computeHelpers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+// The first descriptor pool holds this many sets; every further pool holds twice as many as the
+// one before it.
+constexpr uint32_t firstPoolSetCount = 16;
+// Storage buffer descriptors reserved per set when sizing a pool.
+constexpr uint32_t poolDescriptorsPerSet = 4;
+
+// FNV-1a over the 64-bit words.
+uint64_t hashWords(const auto& words)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const uint64_t word : words)
+    {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// VkBuffer is a pointer on 64-bit targets and a uint64_t elsewhere.
+uint64_t handleBits(const vk::Buffer buffer)
+{
+    const VkBuffer handle = buffer;
+    uint64_t bits = 0;
+    std::memcpy(&bits, &handle, sizeof(handle));
+    return bits;
+}
+
+// Counts a hit and returns the cached object when the signature is known.
+template <typename Map>
+const typename Map::mapped_type* findCached(Map& map, const typename Map::key_type& signature,
+                                            ComputeObjectCache::Statistics::Counts& counts)
+{
+    const auto found = map.find(signature);
+    if (found == map.end())
+    {
+        return nullptr;
+    }
+    ++counts.hits;
+    return &found->second;
+}
+
+// Creates and caches the object, timing only make(): whatever the object depends on must be
+// resolved beforehand so that its cost is counted (once) under its own Counts.
+template <typename Map, typename Make>
+const auto& insertCreated(Map& map, typename Map::key_type signature,
+                          ComputeObjectCache::Statistics::Counts& counts, Make&& make)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    const auto inserted = map.emplace(std::move(signature), make()).first;
+    counts.createMs += elapsedSince(start);
+    ++counts.misses;
+    return inserted->second;
+}
+} // namespace
+
+double ComputeObjectCache::Statistics::Counts::savedMs() const
+{
+    return misses > 0 ? hits * createMs / misses : 0.0;
+}
+
+double ComputeObjectCache::Statistics::savedMs() const
+{
+    return descriptorSetLayouts.savedMs() + pipelineLayouts.savedMs() + pipelines.savedMs() +
+           descriptorSets.savedMs() + descriptorPools.savedMs();
+}
+
+size_t ComputeObjectCache::SignatureHash::operator()(const Signature& signature) const noexcept
+{
+    return static_cast<size_t>(hashWords(signature));
+}
+
+ComputeObjectCache::ComputeObjectCache(const vk::raii::Device& device) : device(device)
+{
+}
+
+const vk::raii::DescriptorSetLayout& ComputeObjectCache::descriptorSetLayout(
+    const uint32_t bindingCount)
+{
+    Signature signature = {bindingCount};
+    if (const auto* cached = findCached(setLayouts, signature, stats.descriptorSetLayouts))
+    {
+        return *cached;
+    }
+    return insertCreated(setLayouts, std::move(signature), stats.descriptorSetLayouts,
+                         [&] { return makeDescriptorSetLayout(device, bindingCount); });
+}
+
+const vk::raii::PipelineLayout& ComputeObjectCache::pipelineLayout(const uint32_t bindingCount,
+                                                                   const uint32_t pushConstantSize)
+{
+    Signature signature = {bindingCount, pushConstantSize};
+    if (const auto* cached = findCached(pipelineLayouts, signature, stats.pipelineLayouts))
+    {
+        return *cached;
+    }
+    const auto& setLayout = descriptorSetLayout(bindingCount);
+    return insertCreated(pipelineLayouts, std::move(signature), stats.pipelineLayouts, [&] {
+        return makePipelineLayout(device, setLayout, pushConstantSize);
+    });
+}
+
+const vk::raii::Pipeline& ComputeObjectCache::pipeline(
+    const std::span<const uint32_t> spirv, const uint32_t bindingCount,
+    const uint32_t pushConstantSize, const std::span<const uint32_t> specializationConstants)
+{
+    Signature signature = {bindingCount, pushConstantSize, hashWords(spirv), spirv.size()};
+    signature.insert(signature.end(), specializationConstants.begin(),
+                     specializationConstants.end());
+    if (const auto* cached = findCached(pipelines, signature, stats.pipelines))
+    {
+        return *cached;
+    }
+    const auto& layout = pipelineLayout(bindingCount, pushConstantSize);
+    return insertCreated(pipelines, std::move(signature), stats.pipelines, [&] {
+        return makePipeline(device, layout, spirv, specializationConstants);
+    });
+}
+
+vk::DescriptorSet ComputeObjectCache::descriptorSet(const std::span<const vk::Buffer> buffers)
+{
+    Signature signature;
+    for (const auto& buffer : buffers)
+    {
+        signature.push_back(handleBits(buffer));
+    }
+    if (const auto* cached = findCached(descriptorSets, signature, stats.descriptorSets))
+    {
+        return *cached;
+    }
+
+    const auto bindingCount = static_cast<uint32_t>(buffers.size());
+    const auto& setLayout = descriptorSetLayout(bindingCount);
+    auto& pool = poolWithRoomFor(bindingCount);
+    return insertCreated(descriptorSets, std::move(signature), stats.descriptorSets, [&] {
+        // the set goes back to its pool on reset(), so it is not freed on its own
+        auto allocated = device.allocateDescriptorSets(
+            vk::DescriptorSetAllocateInfo(*pool.pool, *setLayout));
+        const auto set = allocated.front().release();
+        --pool.remainingSets;
+        pool.remainingDescriptors -= bindingCount;
+
+        updateDescriptorSetsWithBufferInfo(device, buffers, set);
+        return set;
+    });
+}
+
+ComputeObjectCache::DescriptorPool& ComputeObjectCache::poolWithRoomFor(const uint32_t bindingCount)
+{
+    for (; currentPool < descriptorPools.size(); ++currentPool)
+    {
+        auto& pool = descriptorPools[currentPool];
+        if (pool.remainingSets > 0 && pool.remainingDescriptors >= bindingCount)
+        {
+            // only a recycled pool that is used again saved creating one
+            if (!pool.usedThisEpoch)
+            {
+                pool.usedThisEpoch = true;
+                ++stats.descriptorPools.hits;
+            }
+            return pool;
+        }
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    const auto maxSets = firstPoolSetCount << descriptorPools.size();
+    const auto descriptorCount = maxSets * std::max(bindingCount, poolDescriptorsPerSet);
+    const auto descriptorPoolSize =
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, descriptorCount);
+    // no eFreeDescriptorSet: sets are only ever recycled all at once
+    descriptorPools.push_back(
+        {vk::raii::DescriptorPool(device, vk::DescriptorPoolCreateInfo(
+                                              vk::DescriptorPoolCreateFlags(), maxSets,
+                                              descriptorPoolSize)),
+         maxSets, descriptorCount, maxSets, descriptorCount, true});
+    stats.descriptorPools.createMs += elapsedSince(start);
+    ++stats.descriptorPools.misses;
+    return descriptorPools.back();
+}
+
+void ComputeObjectCache::nextEpoch()
+{
+    descriptorSets.clear();
+    for (auto& pool : descriptorPools)
+    {
+        pool.pool.reset();
+        pool.remainingSets = pool.maxSets;
+        pool.remainingDescriptors = pool.maxDescriptors;
+        pool.usedThisEpoch = false;
+    }
+    currentPool = 0;
+    ++stats.epochs;
+}
+
+std::ostream& operator<<(std::ostream& os, const ComputeObjectCache::Statistics& statistics)
+{
+    const auto printCounts = [&os](const char* name, const char* hit, const char* miss,
+                                   const ComputeObjectCache::Statistics::Counts& counts) {
+        os << "  " << name << ": " << counts.hits << " " << hit << ", " << counts.misses << " "
+           << miss << " in " << counts.createMs << " ms\n";
+    };
+
+    os << "Compute object cache after " << statistics.epochs << " epochs:\n";
+    printCounts("descriptor set layouts", "reused", "created", statistics.descriptorSetLayouts);
+    printCounts("pipeline layouts", "reused", "created", statistics.pipelineLayouts);
+    printCounts("pipelines", "reused", "created", statistics.pipelines);
+    printCounts("descriptor sets", "reused without an update", "allocated and written",
+                statistics.descriptorSets);
+    printCounts("descriptor pools", "recycled by reset", "created", statistics.descriptorPools);
+    return os << "  estimated time saved: " << statistics.savedMs() << " ms\n";
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gpuCopy.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Caches the compute objects that only depend on a binding signature, so jobs on the same device
+// stop paying for them:
+//  - descriptor set layouts, pipeline layouts and pipelines, keyed by a hash of the binding count,
+//    push constant size, shader and specialization constants;
+//  - descriptor sets, allocated from pools that grow on demand and are recycled with reset() at
+//    every nextEpoch() instead of being destroyed. Binding the same buffers again within an epoch
+//    returns the same set without another descriptor update.
+class ComputeObjectCache
+{
+  public:
+    struct Statistics
+    {
+        struct Counts
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            double createMs = 0.0; // time spent on the misses
+
+            // what the hits would have cost at the average price of a miss
+            double savedMs() const;
+        };
+
+        Counts descriptorSetLayouts;
+        Counts pipelineLayouts;
+        Counts pipelines;
+        Counts descriptorSets; // a hit skips both the allocation and the update
+        Counts descriptorPools; // a hit is a pool recycled by reset() and used again
+        uint64_t epochs = 0;
+
+        double savedMs() const;
+    };
+
+    explicit ComputeObjectCache(const vk::raii::Device& device);
+
+    // Every binding is a storage buffer, as in makeDescriptorSetLayout.
+    const vk::raii::DescriptorSetLayout& descriptorSetLayout(uint32_t bindingCount);
+
+    const vk::raii::PipelineLayout& pipelineLayout(uint32_t bindingCount,
+                                                   uint32_t pushConstantSize = 0);
+
+    const vk::raii::Pipeline& pipeline(std::span<const uint32_t> spirv, uint32_t bindingCount,
+                                       uint32_t pushConstantSize,
+                                       std::span<const uint32_t> specializationConstants);
+
+    // Set with buffers[i] bound to binding i, valid until the next epoch. The buffers must not be
+    // destroyed before then.
+    vk::DescriptorSet descriptorSet(std::span<const vk::Buffer> buffers);
+
+    // Recycles every descriptor set handed out so far. The caller must make sure none of them is
+    // still in use by the device.
+    void nextEpoch();
+
+    const Statistics& statistics() const
+    {
+        return stats;
+    }
+
+  private:
+    using Signature = std::vector<uint64_t>;
+
+    struct SignatureHash
+    {
+        size_t operator()(const Signature& signature) const noexcept;
+    };
+
+    struct DescriptorPool
+    {
+        vk::raii::DescriptorPool pool;
+        uint32_t maxSets;
+        uint32_t maxDescriptors;
+        uint32_t remainingSets;
+        uint32_t remainingDescriptors;
+        bool usedThisEpoch;
+    };
+
+    DescriptorPool& poolWithRoomFor(uint32_t bindingCount);
+
+    const vk::raii::Device& device;
+    std::unordered_map<Signature, vk::raii::DescriptorSetLayout, SignatureHash> setLayouts;
+    std::unordered_map<Signature, vk::raii::PipelineLayout, SignatureHash> pipelineLayouts;
+    std::unordered_map<Signature, vk::raii::Pipeline, SignatureHash> pipelines;
+    std::vector<DescriptorPool> descriptorPools;
+    size_t currentPool = 0;
+    std::unordered_map<Signature, vk::DescriptorSet, SignatureHash> descriptorSets;
+    Statistics stats;
+};
+
+std::ostream& operator<<(std::ostream& os, const ComputeObjectCache::Statistics& statistics);
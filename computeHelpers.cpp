@@ -0,0 +1,337 @@
+#include "computeHelpers.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <fstream>
+#include <optional>
+#include <ranges>
+
+vk::raii::Instance makeInstance(const vk::raii::Context& context)
+{
+    static constexpr vk::ApplicationInfo applicationInfo = []() {
+        vk::ApplicationInfo temp;
+        temp.pApplicationName = "Compute-Pipeline";
+        temp.applicationVersion = 1;
+        temp.pEngineName = nullptr;
+        temp.engineVersion = 0;
+        temp.apiVersion = VK_MAKE_VERSION(1, 1, 0);
+        return temp;
+    }();
+
+    static constexpr std::array layers = {"VK_LAYER_KHRONOS_validation"};
+    const vk::InstanceCreateInfo instanceCreateInfo(vk::InstanceCreateFlags(), &applicationInfo,
+                                                    layers.size(), layers.data());
+
+    return vk::raii::Instance(context, instanceCreateInfo);
+}
+
+std::expected<uint32_t, VkResult> getBestComputeQueue(
+    const vk::raii::PhysicalDevice& physicalDevice)
+{
+    const auto queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+    // first try and find a queue that has just the compute bit set
+    auto computeWithoutGraphics = [](const auto& properties) {
+        // mask out the sparse binding bit that we aren't caring about (yet!) and
+        // the transfer bit
+        const auto maskedFlags =
+            (~(vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eSparseBinding) &
+             properties.queueFlags);
+        return !(vk::QueueFlagBits::eGraphics & maskedFlags) &&
+               (vk::QueueFlagBits::eCompute & maskedFlags);
+    };
+
+    const auto optimalQueue = std::ranges::find_if(queueFamilyProperties, computeWithoutGraphics);
+    if (optimalQueue != queueFamilyProperties.end())
+    {
+        return std::distance(queueFamilyProperties.begin(), optimalQueue);
+    }
+
+    // lastly get any queue that'll work for us
+    auto hasCompute = [](const auto& properties) -> bool {
+        const auto maskedFlags =
+            (~(vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eSparseBinding) &
+             properties.queueFlags);
+        return (vk::QueueFlagBits::eCompute & maskedFlags) && true;
+    };
+
+    const auto computeQueue = std::ranges::find_if(queueFamilyProperties, hasCompute);
+    if (computeQueue != queueFamilyProperties.end())
+    {
+        return std::distance(queueFamilyProperties.begin(), computeQueue);
+    }
+
+    return std::unexpected{VK_ERROR_INITIALIZATION_FAILED};
+}
+
+uint32_t requireComputeQueue(const vk::raii::PhysicalDevice& physicalDevice)
+{
+    const auto queueFamilyIndex = getBestComputeQueue(physicalDevice);
+    if (!queueFamilyIndex)
+    {
+        BAIL_ON_BAD_RESULT(queueFamilyIndex.error());
+    }
+    return *queueFamilyIndex;
+}
+
+size_t nextPowerOf2(size_t n)
+{
+    size_t v = 1;
+    while (v < n)
+    {
+        v *= 2;
+    }
+    return v;
+}
+
+std::vector<uint32_t> getSpirvFromFile(const std::string_view filePath)
+{
+    using spirv_t = uint32_t;
+    using file_t = char;
+    std::vector<file_t> spvBuffer;
+    {
+        std::ifstream spirvFile(filePath.data(), std::ios::binary | std::ios::ate);
+        const auto size = spirvFile.tellg();
+        spirvFile.seekg(0, std::ios::beg);
+
+        spvBuffer.resize(size);
+
+        if (!spirvFile.read(spvBuffer.data(), size))
+        {
+            std::cout << "Could not read spv file"
+                      << "\n";
+            exit(1);
+        }
+    }
+    constexpr auto sizeDivisor = sizeof(spirv_t) / sizeof(file_t);
+    static_assert(sizeDivisor != 0);
+
+    spvBuffer.resize(sizeDivisor * div_up(spvBuffer.size(), sizeDivisor));
+
+    std::vector<spirv_t> spirvFromFile(spvBuffer.size() / sizeDivisor);
+    assert(spvBuffer.size() == spirvFromFile.size() * sizeDivisor);
+
+    const auto start = reinterpret_cast<spirv_t*>(spvBuffer.data());
+    std::copy(start, start + spirvFromFile.size(), spirvFromFile.data());
+    return spirvFromFile;
+}
+
+uint32_t getLocalGroupSize(const vk::raii::PhysicalDevice& physDev, const uint32_t bufferLength)
+{
+    const auto props2 =
+        physDev
+            .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+    const auto subGroupProps = props2.get<vk::PhysicalDeviceSubgroupProperties>();
+
+    std::cout << "Subgroup Size: " << subGroupProps.subgroupSize << "\n";
+
+    // Adjust the subgroup size to avoid invoking too many workgroups
+    const auto maxWorkGroupCountX = physDev.getProperties().limits.maxComputeWorkGroupCount[0];
+
+    const auto subgroupMultiplier =
+        subGroupProps.subgroupSize * maxWorkGroupCountX > bufferLength
+            ? 1
+            : nextPowerOf2(bufferLength / (maxWorkGroupCountX * subGroupProps.subgroupSize) + 1);
+
+    const uint32_t localGroupSize = subGroupProps.subgroupSize * subgroupMultiplier;
+
+    std::cout << "Local Group Size used: " << localGroupSize << "\n";
+    return localGroupSize;
+}
+
+vk::raii::Device getDevice(const vk::raii::PhysicalDevice& physDev,
+                           const uint32_t queueFamilyIndex)
+{
+    constexpr std::array queuePrioritory = {1.0f};
+    const auto deviceQueueCreateInfo =
+        vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), queueFamilyIndex, queuePrioritory);
+
+    const std::array queueInfos = {deviceQueueCreateInfo};
+    const auto deviceCreateInfo = vk::DeviceCreateInfo(vk::DeviceCreateFlags(), queueInfos);
+
+    return vk::raii::Device(physDev, deviceCreateInfo);
+}
+
+vk::raii::DeviceMemory getDeviceMemory(const vk::raii::Device& device,
+                                       const vk::PhysicalDeviceMemoryProperties& props,
+                                       const vk::DeviceSize memorySize)
+{
+    const auto memoryTypeIndex = [&props, memorySize]() -> std::optional<size_t> {
+        for (const auto& k : std::views::iota(0u, props.memoryTypeCount))
+        {
+            std::cout << to_string(props.memoryTypes[k].propertyFlags) << "\n";
+            if ((vk::MemoryPropertyFlagBits::eHostVisible & props.memoryTypes[k].propertyFlags) &&
+                (vk::MemoryPropertyFlagBits::eHostCoherent & props.memoryTypes[k].propertyFlags) &&
+                (vk::MemoryPropertyFlagBits::eDeviceLocal & props.memoryTypes[k].propertyFlags) &&
+                (memorySize < props.memoryHeaps[props.memoryTypes[k].heapIndex].size))
+            {
+                return k;
+            }
+        }
+        return {};
+    }();
+
+    if (!memoryTypeIndex)
+    {
+        BAIL_ON_BAD_RESULT(VK_ERROR_OUT_OF_HOST_MEMORY);
+    }
+
+    std::cout << "Memory type index: " << *memoryTypeIndex << "\n";
+
+    const vk::MemoryAllocateInfo memoryAllocateInfo(memorySize, *memoryTypeIndex);
+
+    return vk::raii::DeviceMemory(device, memoryAllocateInfo);
+}
+
+CopySlots makeCopySlots(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physDev,
+                        const uint32_t queueFamilyIndex, const uint32_t slotLength,
+                        const uint32_t slotCount)
+{
+    const std::array indices = {queueFamilyIndex};
+    const auto bufferCreateInfo = vk::BufferCreateInfo(
+        vk::BufferCreateFlags(), sizeof(int32_t) * slotLength,
+        vk::BufferUsageFlagBits::eStorageBuffer, vk::SharingMode::eExclusive, indices);
+
+    CopySlots copySlots;
+    vk::DeviceSize memorySize = 0;
+    for ([[maybe_unused]] const auto slotIndex : std::views::iota(0u, slotCount))
+    {
+        auto in_buffer = vk::raii::Buffer(device, bufferCreateInfo);
+        auto out_buffer = vk::raii::Buffer(device, bufferCreateInfo);
+        const auto requirements = in_buffer.getMemoryRequirements();
+        const auto inOffset = alignUp(memorySize, requirements.alignment);
+        const auto outOffset = alignUp(inOffset + requirements.size, requirements.alignment);
+        memorySize = outOffset + requirements.size;
+
+        copySlots.slots.push_back(
+            {std::move(in_buffer), std::move(out_buffer), inOffset, outOffset});
+    }
+
+    copySlots.memory = getDeviceMemory(device, physDev.getMemoryProperties(), memorySize);
+    for (const auto& slot : copySlots.slots)
+    {
+        slot.in_buffer.bindMemory(*copySlots.memory, slot.inOffset);
+        slot.out_buffer.bindMemory(*copySlots.memory, slot.outOffset);
+    }
+
+    copySlots.mapped = static_cast<std::byte*>(copySlots.memory.mapMemory(0, memorySize));
+    if (!copySlots.mapped)
+    {
+        BAIL_ON_BAD_RESULT(VK_ERROR_OUT_OF_HOST_MEMORY);
+    }
+    return copySlots;
+}
+
+vk::raii::DescriptorSetLayout makeDescriptorSetLayout(const vk::raii::Device& device,
+                                                      const uint32_t bindingCount)
+{
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for (const auto binding : std::views::iota(0u, bindingCount))
+    {
+        bindings.emplace_back(binding, vk::DescriptorType::eStorageBuffer, 1,
+                              vk::ShaderStageFlagBits::eCompute, nullptr);
+    }
+
+    auto descriptorSetLayout = vk::raii::DescriptorSetLayout(
+        device, vk::DescriptorSetLayoutCreateInfo(vk::DescriptorSetLayoutCreateFlags(), bindings));
+    return descriptorSetLayout;
+}
+
+vk::raii::PipelineLayout makePipelineLayout(
+    const vk::raii::Device& device, const vk::raii::DescriptorSetLayout& descriptorSetLayout,
+    const uint32_t pushConstantSize)
+{
+    const auto pushConstantRange =
+        vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, pushConstantSize);
+    auto pipelineCreateInfo =
+        vk::PipelineLayoutCreateInfo(vk::PipelineLayoutCreateFlags(), *descriptorSetLayout);
+    if (pushConstantSize > 0)
+    {
+        pipelineCreateInfo.setPushConstantRanges(pushConstantRange);
+    }
+    return vk::raii::PipelineLayout(device, pipelineCreateInfo);
+}
+
+vk::raii::Pipeline makePipeline(const vk::raii::Device& device,
+                                const vk::raii::PipelineLayout& pipelineLayout,
+                                const std::span<const uint32_t> spirv,
+                                const std::span<const uint32_t> specializationConstants)
+{
+    const auto shaderModule = vk::raii::ShaderModule(
+        device, vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), spirv.size_bytes(),
+                                           spirv.data()));
+
+    std::vector<vk::SpecializationMapEntry> specializationEntries;
+    for (const auto constantID : std::views::iota(0u, uint32_t(specializationConstants.size())))
+    {
+        specializationEntries.emplace_back(constantID, uint32_t(constantID * sizeof(uint32_t)),
+                                           sizeof(uint32_t));
+    }
+    const auto specializationInfo = vk::SpecializationInfo(
+        specializationEntries.size(), specializationEntries.data(),
+        specializationConstants.size_bytes(), specializationConstants.data());
+    const auto shaderStageCreateInfo = vk::PipelineShaderStageCreateInfo(
+        vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eCompute, *shaderModule,
+        "main", &specializationInfo);
+
+    const auto computePipelineCreateInfo = vk::ComputePipelineCreateInfo(
+        vk::PipelineCreateFlags(), shaderStageCreateInfo, *pipelineLayout);
+
+    auto pipeline = vk::raii::Pipeline(device, nullptr, computePipelineCreateInfo);
+    return pipeline;
+}
+
+vk::raii::DescriptorPool makeDescriptorPool(const vk::raii::Device& device, const uint32_t maxSets,
+                                            const uint32_t descriptorsPerSet)
+{
+    const auto descriptorPoolSize =
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, maxSets * descriptorsPerSet);
+    const std::array descriptorPoolSizeArray = {descriptorPoolSize};
+    const auto descriptorPoolCreateInfo = vk::DescriptorPoolCreateInfo(
+        vk::DescriptorPoolCreateFlags() | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+        maxSets, descriptorPoolSizeArray);
+
+    assert(descriptorPoolCreateInfo.flags & vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+
+    return vk::raii::DescriptorPool(device, descriptorPoolCreateInfo);
+}
+
+vk::raii::DescriptorSet allocateDescriptorSet(
+    const vk::raii::Device& device, const vk::raii::DescriptorPool& descriptorPool,
+    const vk::raii::DescriptorSetLayout& descriptorSetLayout)
+{
+    const vk::DescriptorSetAllocateInfo descriptorSetAllocateInfo(*descriptorPool,
+                                                                  *descriptorSetLayout);
+
+    auto descriptorSets = device.allocateDescriptorSets(descriptorSetAllocateInfo);
+    assert(descriptorSets.size() == 1);
+    vk::raii::DescriptorSet single = std::move(descriptorSets[0]);
+    return single;
+}
+
+void updateDescriptorSetsWithBufferInfo(const vk::raii::Device& device,
+                                        const std::span<const vk::Buffer> buffers,
+                                        const vk::raii::DescriptorSet& descriptorSet)
+{
+    updateDescriptorSetsWithBufferInfo(device, buffers, *descriptorSet);
+}
+
+void updateDescriptorSetsWithBufferInfo(const vk::raii::Device& device,
+                                        const std::span<const vk::Buffer> buffers,
+                                        const vk::DescriptorSet descriptorSet)
+{
+    std::vector<vk::DescriptorBufferInfo> bufferInfos;
+    for (const auto& buffer : buffers)
+    {
+        bufferInfos.emplace_back(buffer, 0, VK_WHOLE_SIZE);
+    }
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSet;
+    for (const auto binding : std::views::iota(0u, uint32_t(bufferInfos.size())))
+    {
+        writeDescriptorSet.emplace_back(descriptorSet, binding, 0, 1,
+                                        vk::DescriptorType::eStorageBuffer, nullptr,
+                                        &bufferInfos[binding]);
+    }
+    device.updateDescriptorSets(writeDescriptorSet, {});
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "commonHelpers.h"
+#include "gpuCopy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <expected>
+#include <iostream>
+#include <source_location>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Pipeline machinery shared by the compute paths (copy, reduce/scan, ...).
+
+constexpr void BAIL_ON_BAD_RESULT(auto result,
+                                  std::source_location location = std::source_location::current())
+{
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "Failure at line " << location.line() << " in " << location.file_name()
+                  << "\n";
+        exit(-1);
+    }
+}
+
+size_t nextPowerOf2(size_t n);
+
+constexpr vk::DeviceSize alignUp(vk::DeviceSize offset, vk::DeviceSize alignment)
+{
+    return alignment * ((offset + alignment - 1) / alignment);
+}
+
+// p-th quantile (0 to 1) of samples sorted in ascending order.
+inline double percentile(const std::span<const double> sorted, const double p)
+{
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+// Vulkan 1.1 instance with the validation layer enabled.
+vk::raii::Instance makeInstance(const vk::raii::Context& context);
+
+std::expected<uint32_t, VkResult> getBestComputeQueue(
+    const vk::raii::PhysicalDevice& physicalDevice);
+
+// getBestComputeQueue for callers that cannot go on without one.
+uint32_t requireComputeQueue(const vk::raii::PhysicalDevice& physicalDevice);
+
+std::vector<uint32_t> getSpirvFromFile(std::string_view filePath);
+
+uint32_t getLocalGroupSize(const vk::raii::PhysicalDevice& physDev, uint32_t bufferLength);
+
+vk::raii::Device getDevice(const vk::raii::PhysicalDevice& physDev, uint32_t queueFamilyIndex);
+
+vk::raii::DeviceMemory getDeviceMemory(const vk::raii::Device& device,
+                                       const vk::PhysicalDeviceMemoryProperties& props,
+                                       vk::DeviceSize memorySize);
+
+// Every binding is a storage buffer visible to the compute stage.
+vk::raii::DescriptorSetLayout makeDescriptorSetLayout(const vk::raii::Device& device,
+                                                      uint32_t bindingCount = 2);
+
+vk::raii::PipelineLayout makePipelineLayout(
+    const vk::raii::Device& device, const vk::raii::DescriptorSetLayout& descriptorSetLayout,
+    uint32_t pushConstantSize = 0);
+
+// Specialization constant i of the shader gets the value specializationConstants[i].
+vk::raii::Pipeline makePipeline(const vk::raii::Device& device,
+                                const vk::raii::PipelineLayout& pipelineLayout,
+                                std::span<const uint32_t> spirv,
+                                std::span<const uint32_t> specializationConstants);
+
+vk::raii::DescriptorPool makeDescriptorPool(const vk::raii::Device& device, uint32_t maxSets = 1,
+                                            uint32_t descriptorsPerSet = 2);
+
+vk::raii::DescriptorSet allocateDescriptorSet(
+    const vk::raii::Device& device, const vk::raii::DescriptorPool& descriptorPool,
+    const vk::raii::DescriptorSetLayout& descriptorSetLayout);
+
+// copy.comp has no bounds check, so every buffer it runs on must cover whole workgroups.
+constexpr uint32_t copySlotLength(uint32_t maxJobLength, uint32_t localGroupSize)
+{
+    return localGroupSize * div_up(maxJobLength, localGroupSize);
+}
+
+// Input and output buffers of one in-flight copy job, bound to their own ranges of the shared
+// allocation.
+struct CopySlot
+{
+    vk::raii::Buffer in_buffer;
+    vk::raii::Buffer out_buffer;
+    vk::DeviceSize inOffset;
+    vk::DeviceSize outOffset;
+};
+
+// Buffers for slotCount copy jobs of up to slotLength elements each, in one host visible and
+// coherent allocation that stays mapped for the lifetime of the object.
+struct CopySlots
+{
+    vk::raii::DeviceMemory memory = nullptr;
+    std::byte* mapped = nullptr;
+    std::vector<CopySlot> slots;
+
+    int32_t* input(size_t slotIndex) const
+    {
+        return reinterpret_cast<int32_t*>(mapped + slots[slotIndex].inOffset);
+    }
+    int32_t* output(size_t slotIndex) const
+    {
+        return reinterpret_cast<int32_t*>(mapped + slots[slotIndex].outOffset);
+    }
+};
+
+CopySlots makeCopySlots(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physDev,
+                        uint32_t queueFamilyIndex, uint32_t slotLength, uint32_t slotCount);
+
+// Binds buffers[i] (whole size) to binding i of the descriptor set.
+void updateDescriptorSetsWithBufferInfo(const vk::raii::Device& device,
+                                        std::span<const vk::Buffer> buffers,
+                                        const vk::raii::DescriptorSet& descriptorSet);
+void updateDescriptorSetsWithBufferInfo(const vk::raii::Device& device,
+                                        std::span<const vk::Buffer> buffers,
+                                        vk::DescriptorSet descriptorSet);
@@ -0,0 +1,292 @@
+#include "copyDispatch.h"
+
+#include "commonHelpers.h"
+#include "cpuCopy.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// Shorter routed lengths are calibrated as if they were this long, so the two points stay apart.
+constexpr uint32_t minCalibrationLength = 1024;
+// Every copy is timed this many times and the fastest run is kept.
+constexpr uint32_t calibrationRuns = 3;
+
+double timeCall(auto&& call)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    call();
+    return elapsedSince(start);
+}
+
+// Fastest copyOnHost of bufferLength elements; the buffers are allocated and touched beforehand.
+double timeCopyOnHost(const uint32_t bufferLength)
+{
+    const std::vector<int32_t> input(bufferLength);
+    std::vector<int32_t> output(bufferLength);
+    auto fastestMs = std::numeric_limits<double>::max();
+    for ([[maybe_unused]] const auto run : std::views::iota(0u, calibrationRuns))
+    {
+        fastestMs = std::min(fastestMs, timeCall([&] { copyOnHost(input, output); }));
+    }
+    return fastestMs;
+}
+
+// Two points are enough to fit a fixed cost and a per-element cost for each route: half and twice
+// bufferLength, clamped to the range in which copyOnHost keeps the strategy it uses for
+// bufferLength. A line fitted across one of its thresholds would mispredict both sides.
+std::pair<uint32_t, uint32_t> calibrationLengths(const uint32_t bufferLength)
+{
+    constexpr std::array<uint64_t, 4> strategyStarts = {
+        0, hostCopyParallelBytes / sizeof(int32_t), hostCopyNonTemporalBytes / sizeof(int32_t),
+        uint64_t{std::numeric_limits<uint32_t>::max()} + 1};
+
+    const uint64_t length = std::max(bufferLength, minCalibrationLength);
+    const auto strategyEnd = std::ranges::upper_bound(strategyStarts, length);
+    const auto small = std::max(*(strategyEnd - 1), length / 2);
+    const auto large = std::min(*strategyEnd - 1, length * 2);
+    return {static_cast<uint32_t>(small), static_cast<uint32_t>(large)};
+}
+
+// Returns {fixed cost in ms, cost per element in ms} of the line through both measurements.
+std::pair<double, double> fitLine(const uint32_t smallLength, const double smallMs,
+                                  const uint32_t largeLength, const double largeMs)
+{
+    const auto perElement =
+        std::max(0.0, (largeMs - smallMs) / double(largeLength - smallLength));
+    const auto fixed = std::max(0.0, smallMs - perElement * smallLength);
+    return {fixed, perElement};
+}
+
+using DeviceKey = std::array<uint32_t, 3>;
+
+// A saved model only applies to the same device on the same driver.
+DeviceKey deviceKey(const vk::raii::PhysicalDevice& physDev)
+{
+    const auto properties = physDev.getProperties();
+    return {properties.vendorID, properties.deviceID, properties.driverVersion};
+}
+
+// Every line of the model file is "vendor device driver calibratedMinLength calibratedMaxLength
+// hostFixedMs hostMsPerElement deviceSetupMs deviceFixedMs deviceMsPerElement
+// deviceThresholdLength". A device has one line per calibrated range.
+std::optional<DeviceKey> parseDeviceKey(std::istream& fields)
+{
+    DeviceKey key{};
+    if (fields >> key[0] >> key[1] >> key[2])
+    {
+        return key;
+    }
+    return {};
+}
+
+std::optional<std::pair<uint32_t, uint32_t>> parseCalibratedRange(std::istream& fields)
+{
+    uint32_t minLength = 0;
+    uint32_t maxLength = 0;
+    if (fields >> minLength >> maxLength)
+    {
+        return std::pair{minLength, maxLength};
+    }
+    return {};
+}
+
+// The saved model of this device whose calibrated range covers bufferLength, if there is one.
+std::optional<CopyCostModel> loadCopyCostModel(const std::string& modelPath, const DeviceKey& key,
+                                               const uint32_t bufferLength)
+{
+    std::ifstream file(modelPath);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        if (parseDeviceKey(fields) != key)
+        {
+            continue;
+        }
+        const auto range = parseCalibratedRange(fields);
+        if (!range || bufferLength < range->first || bufferLength > range->second)
+        {
+            continue;
+        }
+
+        CopyCostModel model;
+        std::tie(model.calibratedMinLength, model.calibratedMaxLength) = *range;
+        if (fields >> model.hostFixedMs >> model.hostMsPerElement >> model.deviceSetupMs >>
+            model.deviceFixedMs >> model.deviceMsPerElement >> model.deviceThresholdLength)
+        {
+            model.loaded = true;
+            return model;
+        }
+    }
+    return {};
+}
+
+// Adds the model to the file, replacing the lines of this device whose range overlaps its own
+// by more than an end point (or that cannot be read), and keeping all others.
+void saveCopyCostModel(const std::string& modelPath, const DeviceKey& key,
+                       const CopyCostModel& model)
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(modelPath);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            if (parseDeviceKey(fields) != key)
+            {
+                lines.push_back(line);
+                continue;
+            }
+            const auto range = parseCalibratedRange(fields);
+            if (range && (range->second <= model.calibratedMinLength ||
+                          range->first >= model.calibratedMaxLength))
+            {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    std::ofstream file(modelPath, std::ios::trunc);
+    for (const auto& line : lines)
+    {
+        file << line << "\n";
+    }
+    file.precision(std::numeric_limits<double>::max_digits10);
+    file << key[0] << " " << key[1] << " " << key[2] << " " << model.calibratedMinLength << " "
+         << model.calibratedMaxLength << " " << model.hostFixedMs << " "
+         << model.hostMsPerElement << " " << model.deviceSetupMs << " " << model.deviceFixedMs
+         << " " << model.deviceMsPerElement << " " << model.deviceThresholdLength << "\n";
+    if (!file)
+    {
+        std::cout << "Could not save the copy cost model to " << modelPath << "\n";
+    }
+}
+} // namespace
+
+double CopyCostModel::estimatedHostMs(const uint32_t bufferLength) const
+{
+    return copiesPerJob * (hostFixedMs + hostMsPerElement * bufferLength);
+}
+
+double CopyCostModel::estimatedDeviceMs(const uint32_t bufferLength) const
+{
+    return deviceSetupMs + copiesPerJob * (deviceFixedMs + deviceMsPerElement * bufferLength);
+}
+
+CopyCostModel calibrateCopyCostModel(const vk::raii::PhysicalDevice& physDev,
+                                     const uint32_t bufferLength)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    CopyCostModel model;
+    const auto [smallLength, largeLength] = calibrationLengths(bufferLength);
+    // lengths too short to calibrate at are dominated by the fixed costs measured above them
+    model.calibratedMinLength = std::min(smallLength, bufferLength);
+    model.calibratedMaxLength = largeLength;
+
+    std::tie(model.hostFixedMs, model.hostMsPerElement) =
+        fitLine(smallLength, timeCopyOnHost(smallLength), largeLength, timeCopyOnHost(largeLength));
+
+    const auto smallDeviceCopy = timeCopyUsingDevice(physDev, smallLength, calibrationRuns);
+    const auto largeDeviceCopy = timeCopyUsingDevice(physDev, largeLength, calibrationRuns);
+    std::tie(model.deviceFixedMs, model.deviceMsPerElement) =
+        fitLine(smallLength, smallDeviceCopy.copyMs, largeLength, largeDeviceCopy.copyMs);
+    // every job on the device route sets up its own device and pipeline before submitting
+    model.deviceSetupMs = (smallDeviceCopy.setupMs + largeDeviceCopy.setupMs) / 2;
+
+    // estimatedHostMs(n) == estimatedDeviceMs(n), both linear in n
+    const auto fixedDisadvantage = model.estimatedDeviceMs(0) - model.estimatedHostMs(0);
+    const auto slopeAdvantage =
+        copiesPerJob * (model.hostMsPerElement - model.deviceMsPerElement);
+    if (slopeAdvantage <= 0.0)
+    {
+        model.deviceThresholdLength =
+            fixedDisadvantage <= 0.0 ? 0 : std::numeric_limits<uint32_t>::max();
+    }
+    else
+    {
+        const auto crossover = std::max(0.0, fixedDisadvantage / slopeAdvantage);
+        model.deviceThresholdLength = static_cast<uint32_t>(
+            std::min(crossover, double{std::numeric_limits<uint32_t>::max()}));
+    }
+
+    model.calibrationMs = elapsedSince(start);
+    return model;
+}
+
+CopyCostModel loadOrCalibrateCopyCostModel(const vk::raii::PhysicalDevice& physDev,
+                                           const uint32_t bufferLength,
+                                           const std::string& modelPath)
+{
+    const auto key = deviceKey(physDev);
+    if (const auto saved = loadCopyCostModel(modelPath, key, bufferLength))
+    {
+        return *saved;
+    }
+
+    const auto model = calibrateCopyCostModel(physDev, bufferLength);
+    saveCopyCostModel(modelPath, key, model);
+    return model;
+}
+
+CopyRoute chooseCopyRoute(const CopyCostModel& model, const uint32_t bufferLength)
+{
+    return bufferLength >= model.deviceThresholdLength ? CopyRoute::Device : CopyRoute::Host;
+}
+
+std::ostream& operator<<(std::ostream& os, const CopyCostModel& model)
+{
+    os << "Copy cost model (";
+    if (model.loaded)
+    {
+        os << "saved calibration";
+    }
+    else
+    {
+        os << "calibrated in " << model.calibrationMs << " ms";
+    }
+    os << ") for " << model.calibratedMinLength << " to " << model.calibratedMaxLength
+       << " elements:\n"
+       << "  host:   " << copiesPerJob << " x (" << model.hostFixedMs << " ms + "
+       << model.hostMsPerElement * 1e6 << " ms per million elements)\n"
+       << "  device: " << model.deviceSetupMs << " ms setup + " << copiesPerJob << " x ("
+       << model.deviceFixedMs << " ms + " << model.deviceMsPerElement * 1e6
+       << " ms per million elements)\n"
+       << "  device threshold: ";
+    if (model.deviceThresholdLength == std::numeric_limits<uint32_t>::max())
+    {
+        os << "never";
+    }
+    else
+    {
+        os << model.deviceThresholdLength << " elements";
+    }
+    return os << "\n";
+}
+
+int copyUsingBestRoute(const vk::raii::PhysicalDevice& physDev, const CopyCostModel& model,
+                       const uint32_t bufferLength)
+{
+    const auto route = chooseCopyRoute(model, bufferLength);
+    std::cout << "Route for " << bufferLength
+              << " elements: " << (route == CopyRoute::Device ? "device" : "host")
+              << " (estimated host " << model.estimatedHostMs(bufferLength) << " ms, device "
+              << model.estimatedDeviceMs(bufferLength) << " ms)\n";
+
+    return route == CopyRoute::Device ? copyUsingDevice(physDev, bufferLength)
+                                      : copyUsingHost(bufferLength);
+}
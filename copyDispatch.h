@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gpuCopy.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+enum class CopyRoute
+{
+    Host,
+    Device
+};
+
+// Linear cost model of a copy job (copyUsingHost or copyUsingDevice), fitted from timed copies on
+// both routes (copyOnHost, and the device's submit-and-wait). The fixed and per-element costs are
+// per copy and a job makes copiesPerJob of them. A job on the device also pays deviceSetupMs once
+// for the device, pipeline and descriptors it creates, which is what makes small jobs cheaper on
+// the host. Generating and checking the data costs about the same on both routes and is left out.
+// The model is fitted between two lengths within one copyOnHost strategy and is only used for the
+// lengths from calibratedMinLength to calibratedMaxLength.
+struct CopyCostModel
+{
+    uint32_t calibratedMinLength = 0;
+    uint32_t calibratedMaxLength = 0;
+    double hostFixedMs = 0.0;
+    double hostMsPerElement = 0.0;
+    double deviceSetupMs = 0.0;
+    double deviceFixedMs = 0.0;
+    double deviceMsPerElement = 0.0;
+    // smallest buffer length at which the device is expected to win (UINT32_MAX if it never does)
+    uint32_t deviceThresholdLength = 0;
+    double calibrationMs = 0.0;
+    bool loaded = false; // read back from a saved calibration instead of measured
+
+    double estimatedHostMs(uint32_t bufferLength) const;
+    double estimatedDeviceMs(uint32_t bufferLength) const;
+};
+
+// Where loadOrCalibrateCopyCostModel keeps one model per physical device.
+constexpr const char* defaultCopyCostModelPath = "copyCostModel.txt";
+
+// Calibrates at half and twice bufferLength, kept on the same side of hostCopyParallelBytes and
+// hostCopyNonTemporalBytes as bufferLength itself.
+CopyCostModel calibrateCopyCostModel(const vk::raii::PhysicalDevice& physDev,
+                                     uint32_t bufferLength);
+
+// Returns the model saved in modelPath for this device (same vendor, device and driver version)
+// whose calibrated range covers bufferLength. Only when there is none is the device calibrated for
+// bufferLength, and the result saved for later runs. Edit the file to configure a model by hand,
+// or delete it to recalibrate.
+CopyCostModel loadOrCalibrateCopyCostModel(const vk::raii::PhysicalDevice& physDev,
+                                           uint32_t bufferLength,
+                                           const std::string& modelPath = defaultCopyCostModelPath);
+
+CopyRoute chooseCopyRoute(const CopyCostModel& model, uint32_t bufferLength);
+
+std::ostream& operator<<(std::ostream& os, const CopyCostModel& model);
+
+// Runs the copy on whichever route the model picks and reports the decision.
+int copyUsingBestRoute(const vk::raii::PhysicalDevice& physDev, const CopyCostModel& model,
+                       uint32_t bufferLength);
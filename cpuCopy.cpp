@@ -0,0 +1,315 @@
+#include "cpuCopy.h"
+
+#include "commonHelpers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <ranges>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HOST_COPY_AVX2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define HOST_COPY_NEON 1
+#endif
+
+namespace
+{
+using bufferData_t = int32_t;
+
+// Chunks start on cache line boundaries so no two threads write to the same line.
+constexpr size_t chunkAlignmentElements = 64 / sizeof(bufferData_t);
+
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(const unsigned threadCount)
+    {
+        for ([[maybe_unused]] const auto i : std::views::iota(0u, threadCount))
+        {
+            workers.emplace_back([this](std::stop_token stop) { workerLoop(stop); });
+        }
+    }
+
+    size_t size() const
+    {
+        return workers.size() + 1; // the calling thread helps out
+    }
+
+    // Runs task(0) ... task(taskCount - 1) across the pool and blocks until all have finished.
+    void parallelFor(const size_t taskCount, const std::function<void(size_t)>& task)
+    {
+        const std::lock_guard submitLock(submitMutex);
+        {
+            const std::lock_guard lock(mutex);
+            currentTask = &task;
+            currentTaskCount = taskCount;
+            nextTask = 0;
+            remainingTasks = taskCount;
+            ++generation;
+        }
+        wake.notify_all();
+
+        runTasks();
+
+        std::unique_lock lock(mutex);
+        done.wait(lock, [this] { return remainingTasks == 0 && activeWorkers == 0; });
+        currentTask = nullptr;
+    }
+
+  private:
+    void workerLoop(const std::stop_token stop)
+    {
+        uint64_t seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                if (!wake.wait(lock, stop, [&] { return generation != seenGeneration; }))
+                {
+                    return;
+                }
+                seenGeneration = generation;
+                if (remainingTasks == 0)
+                {
+                    // woke up after the job already finished; never touch the next job's state
+                    continue;
+                }
+                ++activeWorkers;
+            }
+
+            runTasks();
+
+            {
+                const std::lock_guard lock(mutex);
+                --activeWorkers;
+            }
+            done.notify_all();
+        }
+    }
+
+    void runTasks()
+    {
+        for (auto index = nextTask.fetch_add(1); index < currentTaskCount;
+             index = nextTask.fetch_add(1))
+        {
+            (*currentTask)(index);
+            if (remainingTasks.fetch_sub(1) == 1)
+            {
+                const std::lock_guard lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    std::mutex submitMutex;
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* currentTask = nullptr;
+    std::atomic<size_t> currentTaskCount = 0;
+    std::atomic<size_t> nextTask = 0;
+    std::atomic<size_t> remainingTasks = 0;
+    size_t activeWorkers = 0;
+    uint64_t generation = 0;
+    // declared last so the workers are stopped and joined before anything they use is destroyed
+    std::vector<std::jthread> workers;
+};
+
+ThreadPool& hostThreadPool()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+#if HOST_COPY_AVX2
+bool hostSupportsAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__attribute__((target("avx2"))) void copyChunkAvx2(const bufferData_t* in, bufferData_t* out,
+                                                    const size_t count, const bool nonTemporal)
+{
+    constexpr size_t lanes = sizeof(__m256i) / sizeof(bufferData_t);
+    size_t i = 0;
+
+    // streaming stores need an aligned destination
+    while (i < count && reinterpret_cast<uintptr_t>(out + i) % sizeof(__m256i) != 0)
+    {
+        out[i] = in[i];
+        ++i;
+    }
+
+    for (; i + 4 * lanes <= count; i += 4 * lanes)
+    {
+        const auto* src = reinterpret_cast<const __m256i*>(in + i);
+        auto* dst = reinterpret_cast<__m256i*>(out + i);
+        const auto v0 = _mm256_loadu_si256(src + 0);
+        const auto v1 = _mm256_loadu_si256(src + 1);
+        const auto v2 = _mm256_loadu_si256(src + 2);
+        const auto v3 = _mm256_loadu_si256(src + 3);
+        if (nonTemporal)
+        {
+            _mm256_stream_si256(dst + 0, v0);
+            _mm256_stream_si256(dst + 1, v1);
+            _mm256_stream_si256(dst + 2, v2);
+            _mm256_stream_si256(dst + 3, v3);
+        }
+        else
+        {
+            _mm256_store_si256(dst + 0, v0);
+            _mm256_store_si256(dst + 1, v1);
+            _mm256_store_si256(dst + 2, v2);
+            _mm256_store_si256(dst + 3, v3);
+        }
+    }
+
+    for (; i < count; ++i)
+    {
+        out[i] = in[i];
+    }
+
+    if (nonTemporal)
+    {
+        // streaming stores are weakly ordered; make them visible before the chunk is reported done
+        _mm_sfence();
+    }
+}
+#endif
+
+#if HOST_COPY_NEON
+// NEON has no non-temporal store intrinsic (STNP is not exposed), so large copies only get the
+// wide loads and stores.
+void copyChunkNeon(const bufferData_t* in, bufferData_t* out, const size_t count)
+{
+    constexpr size_t lanes = 4;
+    size_t i = 0;
+    for (; i + 4 * lanes <= count; i += 4 * lanes)
+    {
+        const auto v0 = vld1q_s32(in + i);
+        const auto v1 = vld1q_s32(in + i + lanes);
+        const auto v2 = vld1q_s32(in + i + 2 * lanes);
+        const auto v3 = vld1q_s32(in + i + 3 * lanes);
+        vst1q_s32(out + i, v0);
+        vst1q_s32(out + i + lanes, v1);
+        vst1q_s32(out + i + 2 * lanes, v2);
+        vst1q_s32(out + i + 3 * lanes, v3);
+    }
+
+    for (; i < count; ++i)
+    {
+        out[i] = in[i];
+    }
+}
+#endif
+
+void copyChunk(const bufferData_t* in, bufferData_t* out, const size_t count,
+               [[maybe_unused]] const bool nonTemporal)
+{
+#if HOST_COPY_AVX2
+    if (hostSupportsAvx2())
+    {
+        copyChunkAvx2(in, out, count, nonTemporal);
+        return;
+    }
+#elif HOST_COPY_NEON
+    copyChunkNeon(in, out, count);
+    return;
+#endif
+    std::memcpy(out, in, count * sizeof(bufferData_t));
+}
+
+void generateRandomData(const std::span<bufferData_t> payloadSpan)
+{
+    const auto inputSpan = payloadSpan.subspan(0, payloadSpan.size() / 2);
+    const auto outputSpan = payloadSpan.subspan(inputSpan.size());
+    auto rng = std::mt19937(std::chrono::steady_clock::now().time_since_epoch().count());
+    std::generate(inputSpan.begin(), inputSpan.end(), rng);
+    std::ranges::fill(outputSpan, 0);
+
+    if (std::ranges::equal(inputSpan, outputSpan))
+    {
+        std::cout << "The memory already had equal values"
+                  << "\n";
+    }
+}
+} // namespace
+
+void copyOnHost(const std::span<const int32_t> input, const std::span<int32_t> output)
+{
+    assert(input.size() == output.size());
+
+    const auto bytes = input.size_bytes();
+    const bool nonTemporal = bytes >= hostCopyNonTemporalBytes;
+    auto& pool = hostThreadPool();
+    if (bytes < hostCopyParallelBytes || pool.size() == 1)
+    {
+        copyChunk(input.data(), output.data(), input.size(), nonTemporal);
+        return;
+    }
+
+    // a few chunks per thread so a thread that gets descheduled does not hold everyone up
+    const auto chunkCount = std::min(pool.size() * 4, div_up(bytes, hostCopyParallelBytes));
+    const auto chunkLength =
+        chunkAlignmentElements * div_up(div_up(input.size(), chunkCount), chunkAlignmentElements);
+
+    pool.parallelFor(div_up(input.size(), chunkLength), [&](const size_t chunk) {
+        const auto first = chunk * chunkLength;
+        const auto count = std::min(chunkLength, input.size() - first);
+        copyChunk(input.data() + first, output.data() + first, count, nonTemporal);
+    });
+}
+
+int copyUsingHost(const uint32_t bufferLength)
+{
+    std::cout << "Host threads: " << hostThreadPool().size() << "\n";
+
+    std::vector<bufferData_t> memory(size_t{bufferLength} * 2);
+    const auto payloadSpan = std::span(memory);
+
+    const auto clock = std::chrono::high_resolution_clock();
+    {
+        const auto start = clock.now();
+        generateRandomData(payloadSpan);
+        const auto elapsed = elapsedSince(start);
+        std::cout << "Random data generation duration: " << elapsed << "\n";
+    }
+
+    const auto frontHalf = payloadSpan.subspan(0, bufferLength);
+    const auto backHalf = payloadSpan.subspan(bufferLength, bufferLength);
+
+    {
+        const auto start = clock.now();
+        std::ranges::for_each(std::views::iota(0u, copiesPerJob),
+                              [&](auto) { copyOnHost(frontHalf, backHalf); });
+        const auto elapsed = elapsedSince(start);
+        std::cout << "Duration of copying data " << copiesPerJob
+                  << " times on CPU: " << elapsed << "\n";
+    }
+
+    const auto [p1, p2] = std::ranges::mismatch(frontHalf, backHalf);
+    if (p1 != frontHalf.end())
+    {
+        std::cout << "Bad at " << std::distance(frontHalf.begin(), p1) << "\n";
+    }
+    if (p2 != backHalf.end())
+    {
+        std::cout << "Bad at " << std::distance(backHalf.begin(), p2) << "\n";
+    }
+
+    return 0;
+}
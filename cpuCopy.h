@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Below this many bytes copyOnHost runs on the calling thread; waking the pool costs more.
+constexpr size_t hostCopyParallelBytes = 256 * 1024;
+// From this many bytes on the destination would evict the whole cache, so copyOnHost streams past
+// it.
+constexpr size_t hostCopyNonTemporalBytes = 8 * 1024 * 1024;
+
+// Host implementation of the copy kernel (copy.comp): vectorized loops split across a thread pool,
+// with non-temporal stores once the copy is too large to be worth keeping in cache.
+void copyOnHost(std::span<const int32_t> input, std::span<int32_t> output);
+
+// Copies of the buffer made by copyUsingHost and by copyUsingDevice.
+constexpr uint32_t copiesPerJob = 10;
+
+// Host counterpart of copyUsingDevice: same data generation, copy loop and verification.
+int copyUsingHost(uint32_t bufferLength);
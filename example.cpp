@@ -1,34 +1,41 @@
-#include "gpuCopy.h"
+#include "asyncCompute.h"
+#include "computeHelpers.h"
+#include "copyDispatch.h"
+#include "cpuCopy.h"
+#include "reduceScan.h"
 
+#include <array>
 #include <chrono>
 #include <iostream>
 
 void copyTest()
 {
-    constexpr vk::ApplicationInfo applicationInfo = []() {
-        vk::ApplicationInfo temp;
-        temp.pApplicationName = "Compute-Pipeline";
-        temp.applicationVersion = 1;
-        temp.pEngineName = nullptr;
-        temp.engineVersion = 0;
-        temp.apiVersion = VK_MAKE_VERSION(1, 1, 0);
-        return temp;
-    }();
-
-    constexpr std::array layers = {"VK_LAYER_KHRONOS_validation"};
-    const vk::InstanceCreateInfo instanceCreateInfo(vk::InstanceCreateFlags(), &applicationInfo,
-                                                    layers.size(), layers.data());
-
     const vk::raii::Context context;
-    const auto instance = vk::raii::Instance(context, instanceCreateInfo);
+    const auto instance = makeInstance(context);
 
     constexpr uint32_t bufferLength = 16384 * 256;
 
-    [[maybe_unused]] const auto physicalDevices = instance.enumeratePhysicalDevices();
+    const auto physicalDevices = instance.enumeratePhysicalDevices();
+
+    if (physicalDevices.empty())
+    {
+        std::cout << "No physical devices found, copying on the host\n";
+        copyUsingHost(bufferLength);
+    }
 
     for (const auto& physDev : physicalDevices)
     {
-        copyUsingDevice(physDev, bufferLength);
+        const auto costModel = loadOrCalibrateCopyCostModel(physDev, bufferLength);
+        std::cout << costModel;
+        copyUsingBestRoute(physDev, costModel, bufferLength);
+        // jobs of different lengths still share their pipelines and descriptor pools
+        reduceAndScanUsingDevice(physDev,
+                                 std::array{bufferLength, bufferLength / 4, bufferLength});
+
+        constexpr uint32_t asyncJobCount = 4096;
+        constexpr uint32_t asyncJobLength = 1024;
+        constexpr unsigned asyncThreadCount = 4;
+        asyncCopyLoadTest(physDev, asyncJobCount, asyncJobLength, asyncThreadCount);
     }
 }
 
@@ -1,5 +1,19 @@
+#pragma once
+
 #define VULKAN_HPP_NO_SMART_HANDLE
 #include "vulkan/vulkan.hpp"
 #include "vulkan/vulkan_raii.hpp"
 
 int copyUsingDevice(const vk::raii::PhysicalDevice& physDev, uint32_t bufferLength);
+
+// Cost of copying bufferLength elements on the device with nothing else in the timings: setupMs
+// covers what copyUsingDevice creates (device, memory, pipeline, descriptors, command buffer) and
+// copyMs is the fastest of copyRuns submit-and-wait rounds.
+struct DeviceCopyTiming
+{
+    double setupMs = 0.0;
+    double copyMs = 0.0;
+};
+
+DeviceCopyTiming timeCopyUsingDevice(const vk::raii::PhysicalDevice& physDev,
+                                     uint32_t bufferLength, uint32_t copyRuns = 1);
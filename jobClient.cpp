@@ -0,0 +1,181 @@
+#include "computeHelpers.h"
+#include "jobProtocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// Load generator for jobServer: every client thread opens its own connection (as a separate
+// client process would) and sends copy jobs back to back. Afterwards the same job is timed through
+// the per-process path (instance, device and pipeline created for the job) for comparison.
+//
+// Usage: jobClient [clients] [jobs per client] [job length] [socket path]
+
+namespace
+{
+using bufferData_t = int32_t;
+
+constexpr uint32_t coldStartRuns = 3;
+
+struct ClientResult
+{
+    std::vector<double> latencies;
+    uint64_t batchSizeSum = 0;
+    uint32_t failures = 0;
+};
+
+ClientResult runClient(const std::string& socketPath, const uint32_t jobCount,
+                       const uint32_t jobLength)
+{
+    ClientResult result;
+
+    const auto connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const auto address = jobSocketAddress(socketPath);
+    if (connection < 0 ||
+        connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        std::cout << "Could not connect to " << socketPath << "\n";
+        result.failures = jobCount;
+        return result;
+    }
+
+    // the same memfd is reused for every job; the server maps it for the duration of each one
+    const auto payloadSize = 2 * sizeof(bufferData_t) * jobLength;
+    const auto payloadFd = memfd_create("copy-job", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    void* mapping = MAP_FAILED;
+    // the server only accepts payloads that can no longer shrink
+    if (payloadFd >= 0 && ftruncate(payloadFd, payloadSize) == 0 &&
+        fcntl(payloadFd, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+    {
+        mapping = mmap(nullptr, payloadSize, PROT_READ | PROT_WRITE, MAP_SHARED, payloadFd, 0);
+    }
+    if (mapping == MAP_FAILED)
+    {
+        std::cout << "Could not create the job payload\n";
+        result.failures = jobCount;
+        close(connection);
+        return result;
+    }
+
+    const auto payload = std::span(static_cast<bufferData_t*>(mapping), 2 * jobLength);
+    const auto input = payload.first(jobLength);
+    const auto output = payload.last(jobLength);
+    auto rng = std::mt19937(std::random_device()());
+
+    for ([[maybe_unused]] const auto job : std::views::iota(0u, jobCount))
+    {
+        std::ranges::generate(input, rng);
+        std::ranges::fill(output, 0);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        JobReply reply{};
+        const auto replied =
+            sendJobRequest(connection, {.length = jobLength}, payloadFd) &&
+            recv(connection, &reply, sizeof(reply), MSG_WAITALL) == sizeof(reply);
+        const auto latency = elapsedSince(start);
+
+        if (!replied || reply.status != 0 || !std::ranges::equal(input, output))
+        {
+            ++result.failures;
+            continue;
+        }
+        result.latencies.push_back(latency);
+        result.batchSizeSum += reply.batchSize;
+    }
+
+    munmap(mapping, payloadSize);
+    close(payloadFd);
+    close(connection);
+    return result;
+}
+
+// What a client process pays without the server: instance, device and pipeline set up for a
+// single copy of jobLength elements. Returns nothing when there is no device to time.
+std::optional<double> coldStartCopyMs(const uint32_t jobLength)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    const vk::raii::Context context;
+    const auto instance = makeInstance(context);
+    const auto physicalDevices = instance.enumeratePhysicalDevices();
+    if (physicalDevices.empty())
+    {
+        return {};
+    }
+    timeCopyUsingDevice(physicalDevices.front(), jobLength);
+    return elapsedSince(start);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint32_t clientCount = argc > 1 ? std::stoul(argv[1]) : 8;
+    const uint32_t jobsPerClient = argc > 2 ? std::stoul(argv[2]) : 500;
+    const uint32_t jobLength = argc > 3 ? std::stoul(argv[3]) : 1024;
+    const std::string socketPath = argc > 4 ? argv[4] : defaultJobSocketPath;
+
+    std::vector<ClientResult> results(clientCount);
+    const auto start = std::chrono::high_resolution_clock::now();
+    {
+        std::vector<std::jthread> clients;
+        for (auto& result : results)
+        {
+            clients.emplace_back(
+                [&] { result = runClient(socketPath, jobsPerClient, jobLength); });
+        }
+    }
+    const auto elapsed = elapsedSince(start);
+
+    std::vector<double> latencies;
+    uint64_t batchSizeSum = 0;
+    uint32_t failures = 0;
+    for (const auto& result : results)
+    {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        batchSizeSum += result.batchSizeSum;
+        failures += result.failures;
+    }
+
+    std::cout << "Job server: " << latencies.size() << " jobs of " << jobLength << " elements from "
+              << clientCount << " clients in " << elapsed << " ms";
+    if (failures > 0)
+    {
+        std::cout << " (" << failures << " failed)";
+    }
+    std::cout << "\n";
+
+    if (!latencies.empty())
+    {
+        std::ranges::sort(latencies);
+        std::cout << "  throughput: " << latencies.size() / (elapsed / 1000.0) << " jobs/s\n"
+                  << "  latency ms: p50 " << percentile(latencies, 0.5) << ", p90 "
+                  << percentile(latencies, 0.9) << ", p99 " << percentile(latencies, 0.99)
+                  << ", max " << latencies.back() << "\n"
+                  << "  mean batch size: " << double(batchSizeSum) / latencies.size() << "\n";
+    }
+
+    double coldStartMs = 0.0;
+    for ([[maybe_unused]] const auto run : std::views::iota(0u, coldStartRuns))
+    {
+        const auto runMs = coldStartCopyMs(jobLength);
+        if (!runMs)
+        {
+            std::cout << "No physical devices found, skipping the per-process comparison\n";
+            return failures == 0 ? 0 : 1;
+        }
+        coldStartMs += *runMs / coldStartRuns;
+    }
+    std::cout << "Per-process startup path: " << coldStartMs << " ms per job ("
+              << 1000.0 / coldStartMs << " jobs/s per process)\n";
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Wire format between jobClient and jobServer over a Unix domain socket. The payload never goes
+// through the socket: with every request the client passes (SCM_RIGHTS) a memfd holding length
+// input elements followed by room for length output elements, and the server writes the output
+// in place before it replies. The memfd must carry F_SEAL_SHRINK (create it with
+// MFD_ALLOW_SEALING), otherwise the client could truncate it while the server has it mapped and
+// kill the server with SIGBUS; unsealed payloads are refused.
+
+constexpr const char* defaultJobSocketPath = "/tmp/vulkan-compute-job-server.sock";
+
+struct JobRequest
+{
+    uint32_t length;
+};
+
+struct JobReply
+{
+    int32_t status; // 0 on success
+    uint32_t batchSize; // number of jobs that shared the submission
+};
+
+inline sockaddr_un jobSocketAddress(const std::string_view path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    return address;
+}
+
+inline bool sendJobRequest(const int socket, const JobRequest& request, const int payloadFd)
+{
+    auto payload = request;
+    iovec iov{.iov_base = &payload, .iov_len = sizeof(payload)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &payloadFd, sizeof(int));
+
+    return sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(payload);
+}
+
+// Returns the request and the received payload fd, which the caller now owns. Returns nothing
+// when the peer hung up or sent something malformed.
+inline std::optional<std::pair<JobRequest, int>> receiveJobRequest(const int socket)
+{
+    JobRequest request{};
+    iovec iov{.iov_base = &request, .iov_len = sizeof(request)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const auto received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    const auto* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+    {
+        return {};
+    }
+
+    int payloadFd = -1;
+    std::memcpy(&payloadFd, CMSG_DATA(header), sizeof(int));
+    if (received != sizeof(request))
+    {
+        close(payloadFd);
+        return {};
+    }
+    return std::make_pair(request, payloadFd);
+}
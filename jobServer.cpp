@@ -0,0 +1,375 @@
+#include "computeCache.h"
+#include "computeHelpers.h"
+#include "jobProtocol.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Keeps one warm device and copy pipeline and serves copy jobs from any number of local client
+// processes. Jobs that arrive within coalesceWindow of each other go to the device as one
+// submission.
+//
+// Usage: jobServer [socket path] [max job length]
+
+namespace
+{
+using bufferData_t = int32_t;
+
+constexpr uint32_t maxBatchSize = 64;
+constexpr auto coalesceWindow = std::chrono::microseconds(500);
+constexpr uint32_t defaultMaxJobLength = 65536;
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+struct PendingJob
+{
+    int client;
+    int payloadFd;
+    uint32_t length;
+};
+
+// A max job length is a positive number that fits in uint32_t, with nothing after it.
+std::optional<uint32_t> parseMaxJobLength(const std::string_view text)
+{
+    uint32_t length = 0;
+    const auto* end = text.data() + text.size();
+    const auto [parsedEnd, error] = std::from_chars(text.data(), end, length);
+    if (error != std::errc() || parsedEnd != end || length == 0)
+    {
+        return {};
+    }
+    return length;
+}
+
+bool sendReply(const int client, const JobReply& reply)
+{
+    return send(client, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply);
+}
+
+class JobServer
+{
+  public:
+    JobServer(const vk::raii::PhysicalDevice& physDev, const uint32_t maxJobLength)
+        : maxJobLength(maxJobLength),
+          queueFamilyIndex(requireComputeQueue(physDev)),
+          localGroupSize(getLocalGroupSize(physDev, maxJobLength)),
+          slotLength(copySlotLength(maxJobLength, localGroupSize)),
+          device(getDevice(physDev, queueFamilyIndex)),
+          queue(device, queueFamilyIndex, 0),
+          cache(device),
+          pipelineLayout(cache.pipelineLayout(2)),
+          pipeline(cache.pipeline(getSpirvFromFile("copy.comp.spv"), 2, 0,
+                                  std::array{localGroupSize})),
+          commandPool(device,
+                      vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                                queueFamilyIndex)),
+          commandBuffer(std::move(vk::raii::CommandBuffers(
+              device, vk::CommandBufferAllocateInfo(*commandPool,
+                                                    vk::CommandBufferLevel::ePrimary, 1))
+                                      .front())),
+          fence(device, vk::FenceCreateInfo()),
+          copySlots(makeCopySlots(device, physDev, queueFamilyIndex, slotLength, maxBatchSize))
+    {
+        // the slot buffers never change, so every set is written once and bound as is afterwards
+        for (const auto& slot : copySlots.slots)
+        {
+            descriptorSets.push_back(
+                cache.descriptorSet(std::array{*slot.in_buffer, *slot.out_buffer}));
+        }
+    }
+
+    uint32_t maxLength() const
+    {
+        return maxJobLength;
+    }
+
+    // Runs up to maxBatchSize jobs as a single submission, then replies to their clients and
+    // closes their payload fds.
+    void runBatch(const std::span<const PendingJob> jobs)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto batchSize = static_cast<uint32_t>(jobs.size());
+
+        std::vector<bufferData_t*> payloads;
+        for (const auto index : std::views::iota(0u, batchSize))
+        {
+            const auto& job = jobs[index];
+            const auto payloadSize = 2 * sizeof(bufferData_t) * job.length;
+            // a payload shorter than the request says would fault on access, so refuse it. The
+            // size check only holds if the client cannot shrink the memfd afterwards, which the
+            // seal guarantees.
+            const auto seals = fcntl(job.payloadFd, F_GET_SEALS);
+            struct stat payloadStat{};
+            const auto payloadFits = seals >= 0 && (seals & F_SEAL_SHRINK) &&
+                                     fstat(job.payloadFd, &payloadStat) == 0 &&
+                                     size_t(payloadStat.st_size) >= payloadSize;
+            auto* payload = payloadFits ? mmap(nullptr, payloadSize, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED, job.payloadFd, 0)
+                                        : MAP_FAILED;
+            payloads.push_back(payload == MAP_FAILED ? nullptr
+                                                     : static_cast<bufferData_t*>(payload));
+            if (payloads.back())
+            {
+                std::copy(payloads.back(), payloads.back() + job.length, copySlots.input(index));
+            }
+        }
+
+        commandBuffer.reset();
+        commandBuffer.begin(
+            vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+        for (const auto index : std::views::iota(0u, batchSize))
+        {
+            if (payloads[index])
+            {
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                                 *pipelineLayout, 0, descriptorSets[index],
+                                                 nullptr);
+                commandBuffer.dispatch(div_up(jobs[index].length, localGroupSize), 1, 1);
+            }
+        }
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {},
+            vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead),
+            nullptr, nullptr);
+        commandBuffer.end();
+
+        queue.submit(vk::SubmitInfo(nullptr, nullptr, *commandBuffer), *fence);
+        const auto waitResult = device.waitForFences(*fence, VK_TRUE, UINT64_MAX);
+        BAIL_ON_BAD_RESULT(static_cast<VkResult>(waitResult));
+        device.resetFences(*fence);
+
+        for (const auto index : std::views::iota(0u, batchSize))
+        {
+            const auto& job = jobs[index];
+            auto* payload = payloads[index];
+            if (payload)
+            {
+                const auto* result = copySlots.output(index);
+                std::copy(result, result + job.length, payload + job.length);
+                munmap(payload, 2 * sizeof(bufferData_t) * job.length);
+            }
+            close(job.payloadFd);
+            sendReply(job.client, {.status = payload ? 0 : -1, .batchSize = batchSize});
+        }
+
+        ++batchCount;
+        jobCount += batchSize;
+        batchMs += elapsedSince(start);
+    }
+
+    void printStatistics() const
+    {
+        std::cout << "Served " << jobCount << " jobs in " << batchCount << " batches";
+        if (batchCount > 0)
+        {
+            std::cout << " (" << double(jobCount) / batchCount << " jobs and "
+                      << batchMs / batchCount << " ms per batch)";
+        }
+        std::cout << "\n";
+    }
+
+  private:
+    uint32_t maxJobLength;
+    uint32_t queueFamilyIndex;
+    uint32_t localGroupSize;
+    uint32_t slotLength;
+    vk::raii::Device device;
+    vk::raii::Queue queue;
+    ComputeObjectCache cache;
+    const vk::raii::PipelineLayout& pipelineLayout;
+    const vk::raii::Pipeline& pipeline;
+    vk::raii::CommandPool commandPool;
+    vk::raii::CommandBuffer commandBuffer;
+    vk::raii::Fence fence;
+    CopySlots copySlots;
+    std::vector<vk::DescriptorSet> descriptorSets; // one per slot, from the cache
+
+    uint64_t batchCount = 0;
+    uint64_t jobCount = 0;
+    double batchMs = 0.0;
+};
+
+int listenOn(const std::string& socketPath)
+{
+    const auto listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const auto address = jobSocketAddress(socketPath);
+    unlink(socketPath.c_str());
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        std::cout << "Could not listen on " << socketPath << "\n";
+        exit(1);
+    }
+    return listener;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    // SIGINT and SIGTERM stay blocked except while ppoll waits, so one that arrives between the
+    // stopRequested check and ppoll is delivered as soon as ppoll starts instead of being missed.
+    // They are blocked before any Vulkan call so that every thread the driver or the layers start
+    // inherits the mask, leaving the ppoll in this thread as the only place they can be handled.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigset_t pollMask;
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &pollMask);
+    sigdelset(&pollMask, SIGINT);
+    sigdelset(&pollMask, SIGTERM);
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+    std::signal(SIGTERM, [](int) { stopRequested = 1; });
+
+    const std::string socketPath = argc > 1 ? argv[1] : defaultJobSocketPath;
+    const auto parsedMaxJobLength = argc > 2 ? parseMaxJobLength(argv[2]) : defaultMaxJobLength;
+    if (!parsedMaxJobLength)
+    {
+        std::cout << "The max job length must be a whole number from 1 to "
+                  << std::numeric_limits<uint32_t>::max() << "\n";
+        return 1;
+    }
+    const auto maxJobLength = *parsedMaxJobLength;
+
+    const vk::raii::Context context;
+    const auto instance = makeInstance(context);
+    const auto physicalDevices = instance.enumeratePhysicalDevices();
+    if (physicalDevices.empty())
+    {
+        std::cout << "No physical devices found\n";
+        return 1;
+    }
+
+    // the shader must be able to address a whole slot, which is the job rounded up to whole
+    // workgroups; whether all slots fit in memory is checked when they are allocated
+    const auto limits = physicalDevices.front().getProperties().limits;
+    const auto maxSlotLength = limits.maxStorageBufferRange / sizeof(bufferData_t);
+    if (maxJobLength > maxSlotLength - limits.maxComputeWorkGroupSize[0])
+    {
+        std::cout << "The max job length must be at most "
+                  << maxSlotLength - limits.maxComputeWorkGroupSize[0] << " on this device\n";
+        return 1;
+    }
+
+    JobServer server(physicalDevices.front(), maxJobLength);
+
+    const auto listener = listenOn(socketPath);
+    std::cout << "Serving copy jobs of up to " << maxJobLength << " elements on " << socketPath
+              << "\n";
+
+    // pollFds[0] is the listening socket, the rest are clients
+    std::vector<pollfd> pollFds = {{.fd = listener, .events = POLLIN, .revents = 0}};
+    std::vector<PendingJob> pendingJobs;
+    auto batchDeadline = std::chrono::steady_clock::time_point::max();
+
+    while (!stopRequested)
+    {
+        timespec timeout{};
+        if (!pendingJobs.empty())
+        {
+            const auto remaining = std::max(std::chrono::steady_clock::duration::zero(),
+                                            batchDeadline - std::chrono::steady_clock::now());
+            timeout.tv_nsec =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        }
+        const auto ready = ppoll(pollFds.data(), pollFds.size(),
+                                 pendingJobs.empty() ? nullptr : &timeout, &pollMask);
+        if (ready < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (ready > 0)
+        {
+            if (pollFds.front().revents & POLLIN)
+            {
+                const auto client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0)
+                {
+                    pollFds.push_back({.fd = client, .events = POLLIN, .revents = 0});
+                }
+            }
+
+            std::erase_if(pollFds, [&](const pollfd& clientFd) {
+                if (clientFd.fd == listener || !clientFd.revents)
+                {
+                    return false;
+                }
+
+                const auto request = receiveJobRequest(clientFd.fd);
+                if (!request)
+                {
+                    // drop its queued jobs too, before the fd number can be reused
+                    std::erase_if(pendingJobs, [&](const PendingJob& job) {
+                        if (job.client != clientFd.fd)
+                        {
+                            return false;
+                        }
+                        close(job.payloadFd);
+                        return true;
+                    });
+                    close(clientFd.fd);
+                    return true;
+                }
+
+                const auto [jobRequest, payloadFd] = *request;
+                if (jobRequest.length == 0 || jobRequest.length > server.maxLength())
+                {
+                    close(payloadFd);
+                    sendReply(clientFd.fd, {.status = -1, .batchSize = 0});
+                    return false;
+                }
+
+                if (pendingJobs.empty())
+                {
+                    batchDeadline = std::chrono::steady_clock::now() + coalesceWindow;
+                }
+                pendingJobs.push_back({clientFd.fd, payloadFd, jobRequest.length});
+                return false;
+            });
+        }
+
+        if (!pendingJobs.empty() && (pendingJobs.size() >= maxBatchSize ||
+                                     std::chrono::steady_clock::now() >= batchDeadline))
+        {
+            const auto batchSize = std::min<size_t>(pendingJobs.size(), maxBatchSize);
+            server.runBatch(std::span(pendingJobs).first(batchSize));
+            pendingJobs.erase(pendingJobs.begin(), pendingJobs.begin() + batchSize);
+            batchDeadline = std::chrono::steady_clock::now() + coalesceWindow;
+        }
+    }
+
+    for (const auto& job : pendingJobs)
+    {
+        close(job.payloadFd);
+    }
+    for (const auto& pollFd : pollFds)
+    {
+        close(pollFd.fd);
+    }
+    unlink(socketPath.c_str());
+    server.printStatistics();
+    return 0;
+}
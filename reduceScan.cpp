@@ -0,0 +1,424 @@
+#include "reduceScan.h"
+
+#include "computeCache.h"
+#include "computeHelpers.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace
+{
+using bufferData_t = int32_t;
+
+// must match ITEMS_PER_INVOCATION in reduce.comp and scan.comp
+constexpr uint32_t itemsPerInvocation = 4;
+
+constexpr size_t numberOfQueueSubmissions = 10;
+
+enum ReduceOperation : uint32_t
+{
+    Sum = 0,
+    Min = 1,
+    Max = 2
+};
+
+enum ScanPass : uint32_t
+{
+    ScanBlocks = 0,
+    AddBlockOffsets = 1
+};
+
+constexpr std::array reduceOperations = {Sum, Min, Max};
+constexpr std::array<const char*, 3> operationNames = {"Sum", "Min", "Max"};
+
+struct PushConstants
+{
+    uint32_t elementCount;
+};
+
+// A buffer bound to its own range of the single memory allocation.
+struct BufferRegion
+{
+    vk::raii::Buffer buffer;
+    vk::DeviceSize offset;
+    uint32_t length;
+};
+
+struct Dispatch
+{
+    const vk::raii::Pipeline* pipeline;
+    vk::DescriptorSet descriptorSet;
+    uint32_t elementCount;
+    uint32_t groupCount;
+};
+
+bool supportsSubgroupArithmetic(const vk::raii::PhysicalDevice& physDev)
+{
+    const auto props2 =
+        physDev
+            .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+    const auto subGroupProps = props2.get<vk::PhysicalDeviceSubgroupProperties>();
+    return (subGroupProps.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+           (subGroupProps.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
+}
+
+// Both shaders are compiled twice: once using subgroup arithmetic, once using only shared memory.
+std::vector<uint32_t> getShaderSpirv(const std::string& shaderName,
+                                     const bool useSubgroupArithmetic)
+{
+    return getSpirvFromFile(shaderName + (useSubgroupArithmetic ? "_subgroup" : "_shared") +
+                            ".comp.spv");
+}
+
+// Length of every level of the hierarchy: level i + 1 holds one value per block of level i, and
+// the last level holds a single value.
+std::vector<uint32_t> hierarchyLengths(const uint32_t length, const uint32_t blockLength)
+{
+    std::vector<uint32_t> lengths = {length};
+    do
+    {
+        lengths.push_back(div_up(lengths.back(), blockLength));
+    } while (lengths.back() > 1);
+    return lengths;
+}
+
+std::vector<BufferRegion> makeBufferRegions(const vk::raii::Device& device,
+                                            const uint32_t queueFamilyIndex,
+                                            const std::span<const uint32_t> lengths,
+                                            vk::DeviceSize& memorySize)
+{
+    const std::array indices = {queueFamilyIndex};
+    std::vector<BufferRegion> regions;
+    for (const auto length : lengths)
+    {
+        const auto bufferCreateInfo = vk::BufferCreateInfo(
+            vk::BufferCreateFlags(), sizeof(bufferData_t) * length,
+            vk::BufferUsageFlagBits::eStorageBuffer, vk::SharingMode::eExclusive, indices);
+        auto buffer = vk::raii::Buffer(device, bufferCreateInfo);
+
+        const auto requirements = buffer.getMemoryRequirements();
+        const auto offset = alignUp(memorySize, requirements.alignment);
+        memorySize = offset + requirements.size;
+
+        regions.push_back({std::move(buffer), offset, length});
+    }
+    return regions;
+}
+
+auto regionSpan(std::byte* mapped, const BufferRegion& region)
+{
+    return std::span(reinterpret_cast<bufferData_t*>(mapped + region.offset), region.length);
+}
+
+void recordDispatches(const vk::raii::CommandBuffer& commandBuffer,
+                      const vk::raii::PipelineLayout& pipelineLayout,
+                      const std::span<const Dispatch> dispatches)
+{
+    const auto computeToCompute =
+        vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite,
+                          vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    const auto computeToHost =
+        vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+
+    commandBuffer.begin(vk::CommandBufferBeginInfo());
+    for (const auto& dispatch : dispatches)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, **dispatch.pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0,
+                                         dispatch.descriptorSet, nullptr);
+        const auto pushConstants = PushConstants{.elementCount = dispatch.elementCount};
+        commandBuffer.pushConstants<PushConstants>(*pipelineLayout,
+                                                   vk::ShaderStageFlagBits::eCompute, 0,
+                                                   pushConstants);
+        commandBuffer.dispatch(dispatch.groupCount, 1, 1);
+
+        // every pass reads what the previous one wrote
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                      vk::PipelineStageFlagBits::eComputeShader, {},
+                                      computeToCompute, nullptr, nullptr);
+    }
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eHost, {}, computeToHost, nullptr,
+                                  nullptr);
+    commandBuffer.end();
+}
+
+double gigabytesPerSecond(const size_t bytes, const double milliseconds)
+{
+    return bytes / (milliseconds * 1e6);
+}
+
+// Average duration in ms of numberOfQueueSubmissions calls.
+double timeRepeated(auto&& call)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::ranges::for_each(std::views::iota(0u, numberOfQueueSubmissions), [&](auto) { call(); });
+    return elapsedSince(start) / numberOfQueueSubmissions;
+}
+
+// Runs reduce/scan jobs one after another on one device. The device, queue, command buffers and
+// the cache of layouts, pipelines and descriptor pools outlive the jobs; only the buffers, their
+// memory and their descriptor sets belong to a single job.
+class ReduceScanRunner
+{
+  public:
+    ReduceScanRunner(const vk::raii::PhysicalDevice& physDev, const uint32_t maxBufferLength)
+        : physDev(physDev),
+          useSubgroupArithmetic(supportsSubgroupArithmetic(physDev)),
+          queueFamilyIndex(requireComputeQueue(physDev)),
+          // every job uses the same pipelines, so they are sized for the longest one
+          localGroupSize(
+              getLocalGroupSize(physDev, div_up(maxBufferLength, itemsPerInvocation))),
+          device(getDevice(physDev, queueFamilyIndex)),
+          queue(device, queueFamilyIndex, 0),
+          commandPool(device,
+                      vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                                queueFamilyIndex)),
+          commandBuffers(device,
+                         vk::CommandBufferAllocateInfo(*commandPool,
+                                                       vk::CommandBufferLevel::ePrimary,
+                                                       reduceOperations.size() + 1)),
+          reduceSpirv(getShaderSpirv("reduce", useSubgroupArithmetic)),
+          scanSpirv(getShaderSpirv("scan", useSubgroupArithmetic)),
+          cache(device)
+    {
+        std::cout << (useSubgroupArithmetic ? "Reducing with subgroup arithmetic"
+                                            : "Reducing with the shared memory fallback")
+                  << "\n";
+    }
+
+    void run(uint32_t bufferLength);
+
+    void printStatistics() const
+    {
+        const auto& statistics = cache.statistics();
+        std::cout << statistics;
+        if (jobCount > 0)
+        {
+            std::cout << "  over " << jobCount << " reduce/scan jobs: "
+                      << statistics.savedMs() / jobCount << " ms saved per job\n";
+        }
+    }
+
+  private:
+    const vk::raii::PhysicalDevice& physDev;
+    bool useSubgroupArithmetic;
+    uint32_t queueFamilyIndex;
+    uint32_t localGroupSize;
+    vk::raii::Device device;
+    vk::raii::Queue queue;
+    vk::raii::CommandPool commandPool;
+    vk::raii::CommandBuffers commandBuffers; // one per reduce operation, then the scan
+    std::vector<uint32_t> reduceSpirv;
+    std::vector<uint32_t> scanSpirv;
+    ComputeObjectCache cache;
+    uint32_t jobCount = 0;
+};
+
+void ReduceScanRunner::run(const uint32_t bufferLength)
+{
+    std::cout << "Reduce/scan job " << jobCount + 1 << ": " << bufferLength << " elements\n";
+    const auto blockLength = localGroupSize * itemsPerInvocation;
+
+    // reduceLevels[0] is the input; scanLevels[0] is the scan output and the other scan levels
+    // hold block sums
+    const auto lengths = hierarchyLengths(bufferLength, blockLength);
+    const auto passCount = static_cast<uint32_t>(lengths.size() - 1);
+    vk::DeviceSize memorySize = 0;
+    const auto reduceLevels = makeBufferRegions(device, queueFamilyIndex, lengths, memorySize);
+    const auto scanLevels = makeBufferRegions(device, queueFamilyIndex, lengths, memorySize);
+
+    const auto memory = getDeviceMemory(device, physDev.getMemoryProperties(), memorySize);
+    for (const auto* regions : {&reduceLevels, &scanLevels})
+    {
+        for (const auto& region : *regions)
+        {
+            region.buffer.bindMemory(*memory, region.offset);
+        }
+    }
+
+    auto* mapped = static_cast<std::byte*>(memory.mapMemory(0, memorySize));
+    if (!mapped)
+    {
+        BAIL_ON_BAD_RESULT(VK_ERROR_OUT_OF_HOST_MEMORY);
+    }
+
+    // small values so that neither the sums nor the prefix sums overflow
+    std::vector<bufferData_t> input(bufferLength);
+    {
+        auto rng = std::mt19937(std::chrono::steady_clock::now().time_since_epoch().count());
+        auto distribution = std::uniform_int_distribution<bufferData_t>(-1000, 1000);
+        std::ranges::generate(input, [&] { return distribution(rng); });
+        std::ranges::copy(input, regionSpan(mapped, reduceLevels.front()).begin());
+    }
+
+    // the reduce pipelines share a layout, as do the two scan pipelines, and the upper scan levels
+    // bind the same buffers for both scan passes. After the first job, only the descriptor sets
+    // are new.
+    const auto& reducePipelineLayout = cache.pipelineLayout(2, sizeof(PushConstants));
+    const auto& scanPipelineLayout = cache.pipelineLayout(3, sizeof(PushConstants));
+
+    std::vector<const vk::raii::Pipeline*> reducePipelines;
+    for (const auto operation : reduceOperations)
+    {
+        reducePipelines.push_back(&cache.pipeline(reduceSpirv, 2, sizeof(PushConstants),
+                                                  std::array{localGroupSize, uint32_t(operation)}));
+    }
+    const auto& scanBlocksPipeline = cache.pipeline(
+        scanSpirv, 3, sizeof(PushConstants), std::array{localGroupSize, uint32_t(ScanBlocks)});
+    const auto& addBlockOffsetsPipeline =
+        cache.pipeline(scanSpirv, 3, sizeof(PushConstants),
+                       std::array{localGroupSize, uint32_t(AddBlockOffsets)});
+
+    // one reduce set and one scan set per pass, plus one add set per pass but the last
+    std::vector<vk::DescriptorSet> reduceSets;
+    std::vector<vk::DescriptorSet> scanSets;
+    std::vector<vk::DescriptorSet> addSets;
+    for (const auto level : std::views::iota(0u, passCount))
+    {
+        reduceSets.push_back(cache.descriptorSet(
+            std::array{*reduceLevels[level].buffer, *reduceLevels[level + 1].buffer}));
+
+        // the first level reads the input, the others scan the block sums in place
+        const auto& scanInput = level == 0 ? reduceLevels.front() : scanLevels[level];
+        scanSets.push_back(cache.descriptorSet(std::array{
+            *scanInput.buffer, *scanLevels[level].buffer, *scanLevels[level + 1].buffer}));
+
+        if (level + 1 < passCount)
+        {
+            addSets.push_back(cache.descriptorSet(std::array{*scanLevels[level].buffer,
+                                                             *scanLevels[level].buffer,
+                                                             *scanLevels[level + 1].buffer}));
+        }
+    }
+
+    for (const auto index : std::views::iota(0u, uint32_t(reduceOperations.size())))
+    {
+        std::vector<Dispatch> dispatches;
+        for (const auto level : std::views::iota(0u, passCount))
+        {
+            dispatches.push_back(
+                {reducePipelines[index], reduceSets[level], lengths[level], lengths[level + 1]});
+        }
+        recordDispatches(commandBuffers[index], reducePipelineLayout, dispatches);
+    }
+
+    auto& scanCommandBuffer = commandBuffers.back();
+    {
+        // scan every level top-down, then add the scanned block sums bottom-up
+        std::vector<Dispatch> dispatches;
+        for (const auto level : std::views::iota(0u, passCount))
+        {
+            dispatches.push_back(
+                {&scanBlocksPipeline, scanSets[level], lengths[level], lengths[level + 1]});
+        }
+        for (const auto level : std::views::iota(0u, passCount - 1) | std::views::reverse)
+        {
+            dispatches.push_back(
+                {&addBlockOffsetsPipeline, addSets[level], lengths[level], lengths[level + 1]});
+        }
+        recordDispatches(scanCommandBuffer, scanPipelineLayout, dispatches);
+    }
+
+    const auto submit = [&](const vk::raii::CommandBuffer& commandBuffer) {
+        queue.submit(vk::SubmitInfo(nullptr, nullptr, *commandBuffer));
+        queue.waitIdle();
+    };
+
+    const auto inputBytes = input.size() * sizeof(bufferData_t);
+    const auto hostReduce = [&input](const ReduceOperation operation) {
+        switch (operation)
+        {
+        case Min:
+            return std::reduce(std::execution::par_unseq, input.begin(), input.end(),
+                               std::numeric_limits<bufferData_t>::max(),
+                               [](auto a, auto b) { return std::min(a, b); });
+        case Max:
+            return std::reduce(std::execution::par_unseq, input.begin(), input.end(),
+                               std::numeric_limits<bufferData_t>::min(),
+                               [](auto a, auto b) { return std::max(a, b); });
+        case Sum:
+        default:
+            return std::reduce(std::execution::par_unseq, input.begin(), input.end(),
+                               bufferData_t{0});
+        }
+    };
+
+    for (const auto index : std::views::iota(0u, uint32_t(reduceOperations.size())))
+    {
+        const auto deviceMs = timeRepeated([&] { submit(commandBuffers[index]); });
+        const auto deviceResult = regionSpan(mapped, reduceLevels.back()).front();
+
+        bufferData_t hostResult = 0;
+        const auto hostMs =
+            timeRepeated([&] { hostResult = hostReduce(reduceOperations[index]); });
+
+        std::cout << operationNames[index] << " on GPU: " << deviceResult << " in " << deviceMs
+                  << " ms (" << gigabytesPerSecond(inputBytes, deviceMs)
+                  << " GB/s), std::reduce: " << hostResult << " in " << hostMs << " ms ("
+                  << gigabytesPerSecond(inputBytes, hostMs) << " GB/s)\n";
+        if (deviceResult != hostResult)
+        {
+            std::cout << operationNames[index] << " mismatch\n";
+        }
+    }
+
+    {
+        // the scan reads the input and writes the output
+        const auto scanBytes = 2 * inputBytes;
+        const auto deviceMs = timeRepeated([&] { submit(scanCommandBuffer); });
+        const auto deviceScan = regionSpan(mapped, scanLevels.front());
+
+        std::vector<bufferData_t> hostScan(input.size());
+        const auto hostMs = timeRepeated([&] {
+            std::exclusive_scan(std::execution::par_unseq, input.begin(), input.end(),
+                                hostScan.begin(), bufferData_t{0});
+        });
+
+        std::cout << "Exclusive scan on GPU: " << deviceMs << " ms ("
+                  << gigabytesPerSecond(scanBytes, deviceMs)
+                  << " GB/s), std::exclusive_scan: " << hostMs << " ms ("
+                  << gigabytesPerSecond(scanBytes, hostMs) << " GB/s)\n";
+
+        const auto [p1, p2] = std::ranges::mismatch(deviceScan, hostScan);
+        if (p1 != deviceScan.end())
+        {
+            std::cout << "Bad at " << std::distance(deviceScan.begin(), p1) << "\n";
+        }
+    }
+
+    // every submission has been waited for, so the sets go back to their pools before the
+    // buffers they bind are destroyed
+    cache.nextEpoch();
+    ++jobCount;
+    memory.unmapMemory();
+}
+} // namespace
+
+int reduceAndScanUsingDevice(const vk::raii::PhysicalDevice& physDev,
+                             const std::span<const uint32_t> jobLengths)
+{
+    if (jobLengths.empty())
+    {
+        return 0;
+    }
+
+    ReduceScanRunner runner(physDev, std::ranges::max(jobLengths));
+    for (const auto bufferLength : jobLengths)
+    {
+        runner.run(bufferLength);
+    }
+    runner.printStatistics();
+    return 0;
+}
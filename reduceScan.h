@@ -0,0 +1,16 @@
+#pragma once
+
+#include "gpuCopy.h"
+
+#include <cstdint>
+#include <span>
+
+// Sum, min and max reductions and an exclusive prefix sum over a random buffer, checked and
+// benchmarked (GB/s) against std::reduce / std::exclusive_scan with std::execution::par_unseq.
+// Uses subgroup arithmetic when the device supports it in compute shaders, and shared memory
+// otherwise.
+//
+// Runs one such job per entry of jobLengths on the same device. Their layouts, pipelines and
+// descriptor pools come from one ComputeObjectCache, whose statistics are printed at the end.
+int reduceAndScanUsingDevice(const vk::raii::PhysicalDevice& physDev,
+                             std::span<const uint32_t> jobLengths);